@@ -0,0 +1,212 @@
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "serialize.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** Size of the magic and length that precede every record */
+static const unsigned int RECORD_HEADER_SIZE = MESSAGE_START_SIZE + sizeof(uint32_t);
+
+CBlockFileReader blockFileReader;
+
+/** Read-only mapping of a whole block file, unmapped once no record uses it */
+class CBlockFileMapping
+{
+public:
+    const char* pdata;
+    size_t nLength;
+
+    CBlockFileMapping(const char* pdataIn, size_t nLengthIn) : pdata(pdataIn), nLength(nLengthIn) {}
+    CBlockFileMapping(const CBlockFileMapping&) = delete;
+    CBlockFileMapping& operator=(const CBlockFileMapping&) = delete;
+    ~CBlockFileMapping()
+    {
+#ifndef WIN32
+        munmap(const_cast<char*>(pdata), nLength);
+#endif
+    }
+};
+
+class CBlockFileHandle
+{
+public:
+    std::string strName;
+    FILE* file;
+    //! Guards the file position and the mapping
+    std::mutex cs;
+    std::shared_ptr<const CBlockFileMapping> mapping;
+
+    CBlockFileHandle(const std::string& strNameIn, FILE* fileIn) : strName(strNameIn), file(fileIn) {}
+    CBlockFileHandle(const CBlockFileHandle&) = delete;
+    CBlockFileHandle& operator=(const CBlockFileHandle&) = delete;
+    ~CBlockFileHandle() { fclose(file); }
+
+    /** Map the file as it is now; it may have grown since the last mapping. */
+    bool Remap()
+    {
+#ifdef WIN32
+        return false;
+#else
+        struct stat st;
+        if (fstat(fileno(file), &st) != 0 || st.st_size <= 0)
+            return false;
+        if (mapping && mapping->nLength == (size_t)st.st_size)
+            return true;
+        void* pdata = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (pdata == MAP_FAILED) {
+            LogPrintf("Unable to map %s: %s\n", strName, strerror(errno));
+            return false;
+        }
+        mapping = std::make_shared<const CBlockFileMapping>((const char*)pdata, st.st_size);
+        return true;
+#endif
+    }
+};
+
+static bool CheckRecordHeader(const unsigned char* header, unsigned int& nSize)
+{
+    if (memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : bad magic", __func__);
+    nSize = ReadLE32(header + MESSAGE_START_SIZE);
+    if (nSize > MAX_SIZE)
+        return error("%s : record size %u too large", __func__, nSize);
+    return true;
+}
+
+CBlockFileReader::CBlockFileReader(size_t nMaxOpenFilesIn) : nMaxOpenFiles(std::max<size_t>(nMaxOpenFilesIn, 1)), fUseMmap(DEFAULT_BLOCK_MMAP)
+{
+}
+
+void CBlockFileReader::SetUseMmap(bool fUseMmapIn)
+{
+#ifdef WIN32
+    fUseMmapIn = false;
+#endif
+    Clear();
+    fUseMmap = fUseMmapIn;
+}
+
+std::shared_ptr<CBlockFileHandle> CBlockFileReader::GetFile(const CDiskBlockPos& pos, const char* prefix)
+{
+    std::lock_guard<std::mutex> lock(cs);
+
+    FileKey key(prefix, pos.nFile);
+    auto it = mapFiles.find(key);
+    if (it != mapFiles.end()) {
+        listFiles.splice(listFiles.begin(), listFiles, it->second);
+        return it->second->second;
+    }
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    // The file is preallocated past its last record and keeps being appended
+    // to through other handles, so a stdio read buffer would serve stale zeros
+    setvbuf(file, nullptr, _IONBF, 0);
+    auto handle = std::make_shared<CBlockFileHandle>(path.string(), file);
+    listFiles.emplace_front(key, handle);
+    mapFiles[key] = listFiles.begin();
+
+    while (listFiles.size() > nMaxOpenFiles) {
+        mapFiles.erase(listFiles.back().first);
+        listFiles.pop_back();
+    }
+    return handle;
+}
+
+bool CBlockFileReader::Read(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailing, CBlockFileRecord& record)
+{
+    if (pos.IsNull() || pos.nPos < RECORD_HEADER_SIZE)
+        return error("%s : invalid position %d:%u", __func__, pos.nFile, pos.nPos);
+
+    std::shared_ptr<CBlockFileHandle> handle = GetFile(pos, prefix);
+    if (!handle)
+        return false;
+
+    std::unique_lock<std::mutex> lock(handle->cs);
+    unsigned int nSize;
+
+    if (fUseMmap && ((handle->mapping && handle->mapping->nLength >= pos.nPos) || handle->Remap())) {
+        if (handle->mapping->nLength < pos.nPos)
+            return error("%s : position %u beyond end of %s", __func__, pos.nPos, handle->strName);
+        if (!CheckRecordHeader((const unsigned char*)handle->mapping->pdata + pos.nPos - RECORD_HEADER_SIZE, nSize))
+            return error("%s : bad record header at %u in %s", __func__, pos.nPos, handle->strName);
+        uint64_t nEnd = (uint64_t)pos.nPos + nSize + nTrailing;
+        if (nEnd > handle->mapping->nLength && (!handle->Remap() || nEnd > handle->mapping->nLength))
+            return error("%s : record at %u runs past end of %s", __func__, pos.nPos, handle->strName);
+
+        record.mapping = handle->mapping;
+        record.vch.clear();
+        record.pbegin = record.mapping->pdata + pos.nPos;
+        record.pend = record.mapping->pdata + nEnd;
+        lock.unlock();
+
+#ifndef WIN32
+        // Ask for the whole record up front instead of faulting it in page by page
+        static const uintptr_t nPageMask = ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+        uintptr_t nStart = (uintptr_t)record.pbegin & nPageMask;
+        madvise((void*)nStart, (uintptr_t)record.pend - nStart, MADV_WILLNEED);
+#endif
+        return true;
+    }
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    if (fseek(handle->file, pos.nPos - RECORD_HEADER_SIZE, SEEK_SET) != 0 ||
+        fread(header, 1, sizeof(header), handle->file) != sizeof(header))
+        return error("%s : unable to read record header at %u in %s", __func__, pos.nPos, handle->strName);
+    if (!CheckRecordHeader(header, nSize))
+        return error("%s : bad record header at %u in %s", __func__, pos.nPos, handle->strName);
+
+    record.mapping.reset();
+    record.vch.resize((size_t)nSize + nTrailing);
+    if (fread(record.vch.data(), 1, record.vch.size(), handle->file) != record.vch.size())
+        return error("%s : record at %u runs past end of %s", __func__, pos.nPos, handle->strName);
+    record.pbegin = record.vch.data();
+    record.pend = record.pbegin + record.vch.size();
+    return true;
+}
+
+void CBlockFileReader::Close(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    for (auto it = listFiles.begin(); it != listFiles.end();) {
+        if (it->first.second == nFile) {
+            mapFiles.erase(it->first);
+            it = listFiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CBlockFileReader::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mapFiles.clear();
+    listFiles.clear();
+}
+
+size_t CBlockFileReader::OpenFiles()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return listFiles.size();
+}
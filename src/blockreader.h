@@ -0,0 +1,98 @@
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADER_H
+#define BITCOIN_BLOCKREADER_H
+
+#include "chain.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Number of blk/rev files kept open for reading */
+static const size_t MAX_OPEN_BLOCK_FILES = 8;
+/** Map block files into memory instead of reading them into a buffer */
+#if defined(WIN32) || !defined(__LP64__)
+static const bool DEFAULT_BLOCK_MMAP = false;
+#else
+static const bool DEFAULT_BLOCK_MMAP = true;
+#endif
+
+class CBlockFileMapping;
+class CBlockFileHandle;
+
+/**
+ * One record (block or undo data) of a blk/rev file. The bytes either live
+ * in a read-only mapping of the file, which the record keeps alive, or in a
+ * private buffer when mapping is disabled.
+ */
+class CBlockFileRecord
+{
+private:
+    std::shared_ptr<const CBlockFileMapping> mapping;
+    std::vector<char> vch;
+    const char* pbegin;
+    const char* pend;
+
+    friend class CBlockFileReader;
+
+public:
+    CBlockFileRecord() : pbegin(nullptr), pend(nullptr) {}
+    CBlockFileRecord(const CBlockFileRecord&) = delete;
+    CBlockFileRecord& operator=(const CBlockFileRecord&) = delete;
+
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pend; }
+    size_t size() const { return pend - pbegin; }
+};
+
+/**
+ * Reads records back from the blk/rev files. Instead of opening, seeking and
+ * closing the file for every block, the most recently used files are kept
+ * open, and with mmap enabled a record is deserialized straight from the
+ * page cache without being copied first.
+ */
+class CBlockFileReader
+{
+private:
+    typedef std::pair<std::string, int> FileKey;
+    typedef std::list<std::pair<FileKey, std::shared_ptr<CBlockFileHandle> > > FileList;
+
+    std::mutex cs;
+    size_t nMaxOpenFiles;
+    bool fUseMmap;
+    //! Open files, most recently used first
+    FileList listFiles;
+    std::map<FileKey, FileList::iterator> mapFiles;
+
+    std::shared_ptr<CBlockFileHandle> GetFile(const CDiskBlockPos& pos, const char* prefix);
+
+public:
+    explicit CBlockFileReader(size_t nMaxOpenFilesIn = MAX_OPEN_BLOCK_FILES);
+
+    /** Enable or disable mmap for files opened from now on; closes all open files */
+    void SetUseMmap(bool fUseMmapIn);
+    bool UseMmap() const { return fUseMmap; }
+
+    /**
+     * Read the record at pos, whose length is stored in the record header
+     * just before it, plus nTrailing bytes that follow the record (e.g. the
+     * checksum of undo data).
+     */
+    bool Read(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailing, CBlockFileRecord& record);
+
+    /** Close the blk and rev files numbered nFile, e.g. after truncating them */
+    void Close(int nFile);
+    void Clear();
+    size_t OpenFiles();
+};
+
+extern CBlockFileReader blockFileReader;
+
+#endif // BITCOIN_BLOCKREADER_H
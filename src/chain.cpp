@@ -7,6 +7,27 @@
 #include "chain.h"
 
 
+/**
+ * CBlockIndexArena implementation
+ */
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        size_t nUsed = ENTRIES_PER_CHUNK;
+        if (i + 1 == vChunks.size())
+            nUsed = nUsedInLastChunk;
+        for (size_t j = 0; j < nUsed; j++) {
+            vChunks[i][j].~CBlockIndex();
+            vColdChunks[i][j].~CBlockIndexCold();
+        }
+        ::operator delete(vChunks[i]);
+        ::operator delete(vColdChunks[i]);
+    }
+    vChunks.clear();
+    vColdChunks.clear();
+    nUsedInLastChunk = ENTRIES_PER_CHUNK;
+}
+
 /**
  * CChain implementation
  */
@@ -14,6 +14,11 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 
@@ -98,6 +103,150 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/**
+ * Number of zerocoin mints per denomination, held in a fixed array ordered
+ * like libzerocoin::zerocoinDenomList. Serializes exactly like the
+ * std::map<CoinDenomination, int64_t> that used to live in every block index.
+ */
+class CZerocoinSupply
+{
+private:
+    static const size_t DENOMINATIONS = 8;
+    int64_t vSupply[DENOMINATIONS];
+
+    static int Index(libzerocoin::CoinDenomination denom)
+    {
+        switch (denom) {
+        case libzerocoin::ZQ_ONE: return 0;
+        case libzerocoin::ZQ_FIVE: return 1;
+        case libzerocoin::ZQ_TEN: return 2;
+        case libzerocoin::ZQ_FIFTY: return 3;
+        case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+        case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+        case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+        case libzerocoin::ZQ_FIVE_THOUSAND: return 7;
+        default: return -1;
+        }
+    }
+
+public:
+    CZerocoinSupply()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        std::fill(vSupply, vSupply + DENOMINATIONS, 0);
+    }
+
+    int64_t& at(libzerocoin::CoinDenomination denom)
+    {
+        int i = Index(denom);
+        if (i < 0)
+            throw std::out_of_range("CZerocoinSupply::at() : invalid denomination");
+        return vSupply[i];
+    }
+
+    const int64_t& at(libzerocoin::CoinDenomination denom) const
+    {
+        return const_cast<CZerocoinSupply*>(this)->at(denom);
+    }
+
+    friend bool operator==(const CZerocoinSupply& a, const CZerocoinSupply& b)
+    {
+        return std::equal(a.vSupply, a.vSupply + DENOMINATIONS, b.vSupply);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(DENOMINATIONS);
+        for (auto& denom : libzerocoin::zerocoinDenomList)
+            nSize += ::GetSerializeSize(denom, nType, nVersion) + ::GetSerializeSize(at(denom), nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, DENOMINATIONS);
+        for (auto& denom : libzerocoin::zerocoinDenomList) {
+            ::Serialize(s, denom, nType, nVersion);
+            ::Serialize(s, at(denom), nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        SetNull();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nVersion);
+            ::Unserialize(s, nSupply, nType, nVersion);
+            int n = Index(denom);
+            if (n >= 0)
+                vSupply[n] = nSupply;
+        }
+    }
+};
+
+/**
+ * Block index data that is only read while connecting blocks, answering RPCs
+ * or writing the index back to disk. It is kept out of line so the fields
+ * touched by GetAncestor walks and chain selection stay within a few cache
+ * lines of each CBlockIndex.
+ */
+struct CBlockIndexCold {
+    // proof-of-stake specific fields
+    uint256 bnStakeModifierV2;
+    unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
+    uint256 hashProofOfStake;
+
+    //! zerocoin specific fields
+    CZerocoinSupply zerocoinSupply;
+    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+
+    CBlockIndexCold() : nStakeModifierChecksum(0), nStakeTime(0) {}
+};
+
+/**
+ * Handle to a CBlockIndexCold; copying a CBlockIndex copies its cold data too.
+ * Entries of mapBlockIndex use storage owned by CBlockIndexArena, any other
+ * CBlockIndex allocates its own.
+ */
+class CBlockIndexColdPtr
+{
+private:
+    CBlockIndexCold* ptr;
+    bool fOwned;
+
+public:
+    CBlockIndexColdPtr() : ptr(new CBlockIndexCold()), fOwned(true) {}
+    explicit CBlockIndexColdPtr(CBlockIndexCold* ptrIn) : ptr(ptrIn), fOwned(false) {}
+    CBlockIndexColdPtr(const CBlockIndexColdPtr& other) : ptr(new CBlockIndexCold(*other)), fOwned(true) {}
+    ~CBlockIndexColdPtr()
+    {
+        if (fOwned)
+            delete ptr;
+    }
+
+    CBlockIndexColdPtr& operator=(const CBlockIndexColdPtr& other)
+    {
+        *ptr = *other;
+        return *this;
+    }
+
+    CBlockIndexCold& operator*() { return *ptr; }
+    const CBlockIndexCold& operator*() const { return *ptr; }
+    CBlockIndexCold* operator->() { return ptr; }
+    const CBlockIndexCold* operator->() const { return ptr; }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -112,18 +261,18 @@ public:
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
 
-    //! pointer to the index of the next block
-    CBlockIndex* pnext;
-
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //ppcoin: trust score of block chain
-    uint256 bnChainTrust;
-
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! pointer to the index of the next block
+    CBlockIndex* pnext;
+
+    //ppcoin: trust score of block chain
+    uint256 bnChainTrust;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -158,11 +307,6 @@ public:
     // proof-of-stake specific fields
     uint256 GetBlockTrust() const;
     uint64_t nStakeModifier;             // hash modifier for proof-of-stake
-    uint256 bnStakeModifierV2;
-    unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
-    COutPoint prevoutStake;
-    unsigned int nStakeTime;
-    uint256 hashProofOfStake;
     int64_t nMint;
     int64_t nMoneySupply;
 
@@ -177,9 +321,8 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+    //! rarely used stake and zerocoin fields
+    CBlockIndexColdPtr cold;
 
     void SetNull()
     {
@@ -200,10 +343,7 @@ public:
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
-        bnStakeModifierV2 = 0;
-        nStakeModifierChecksum = 0;
-        prevoutStake.SetNull();
-        nStakeTime = 0;
+        *cold = CBlockIndexCold();
 
         nVersion = 0;
         hashMerkleRoot = uint256();
@@ -211,11 +351,6 @@ public:
         nBits = 0;
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
-        // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(std::make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
     }
 
     CBlockIndex()
@@ -224,6 +359,22 @@ public:
     }
 
     CBlockIndex(const CBlock& block)
+    {
+        SetFromBlock(block);
+    }
+
+    //! Used by CBlockIndexArena, which owns pcold
+    explicit CBlockIndex(CBlockIndexCold* pcold) : cold(pcold)
+    {
+        SetNull();
+    }
+
+    CBlockIndex(CBlockIndexCold* pcold, const CBlock& block) : cold(pcold)
+    {
+        SetFromBlock(block);
+    }
+
+    void SetFromBlock(const CBlock& block)
     {
         SetNull();
 
@@ -241,16 +392,11 @@ public:
         nMoneySupply = 0;
         nFlags = 0;
         nStakeModifier = 0;
-        nStakeModifierChecksum = 0;
-        hashProofOfStake = uint256();
 
         if (block.IsProofOfStake()) {
             SetProofOfStake();
-            prevoutStake = block.vtx[1].vin[0].prevout;
-            nStakeTime = block.nTime;
-        } else {
-            prevoutStake.SetNull();
-            nStakeTime = 0;
+            cold->prevoutStake = block.vtx[1].vin[0].prevout;
+            cold->nStakeTime = block.nTime;
         }
     }
 
@@ -305,7 +451,7 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return cold->zerocoinSupply.at(denom);
     }
 
     /**
@@ -320,7 +466,7 @@ public:
 
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return std::find(cold->vMintDenominationsInBlock.begin(), cold->vMintDenominationsInBlock.end(), denom) != cold->vMintDenominationsInBlock.end();
     }
 
     uint256 GetBlockHash() const
@@ -484,12 +630,12 @@ public:
         READWRITE(nFlags);
         READWRITE(nStakeModifier);
         if (IsProofOfStake()) {
-            READWRITE(prevoutStake);
-            READWRITE(nStakeTime);
+            READWRITE(cold->prevoutStake);
+            READWRITE(cold->nStakeTime);
         } else {
-            const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
-            const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-            const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = GetProofOfWorkHash();
+            cold->prevoutStake.SetNull();
+            cold->nStakeTime = 0;
+            cold->hashProofOfStake = GetProofOfWorkHash();
         }
 
         // block header
@@ -502,10 +648,10 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 7) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
-            READWRITE(vMintDenominationsInBlock);
+            READWRITE(cold->zerocoinSupply);
+            READWRITE(cold->vMintDenominationsInBlock);
         }else{
-            READWRITE(bnStakeModifierV2);
+            READWRITE(cold->bnStakeModifierV2);
         }
 
     }
@@ -547,6 +693,53 @@ public:
     }
 };
 
+/**
+ * Storage for the entries of mapBlockIndex. Entries and their cold data are
+ * constructed in large chunks instead of being heap allocated one by one, and
+ * are only ever destroyed all together.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t ENTRIES_PER_CHUNK = 4096;
+
+    std::vector<CBlockIndex*> vChunks;
+    //! Cold data of the entries, chunk by chunk and in the same order
+    std::vector<CBlockIndexCold*> vColdChunks;
+    size_t nUsedInLastChunk;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nUsedInLastChunk(ENTRIES_PER_CHUNK) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args>
+    CBlockIndex* Create(Args&&... args)
+    {
+        if (nUsedInLastChunk == ENTRIES_PER_CHUNK) {
+            vChunks.reserve(vChunks.size() + 1);
+            vColdChunks.reserve(vColdChunks.size() + 1);
+            vChunks.push_back(static_cast<CBlockIndex*>(::operator new(sizeof(CBlockIndex) * ENTRIES_PER_CHUNK)));
+            vColdChunks.push_back(static_cast<CBlockIndexCold*>(::operator new(sizeof(CBlockIndexCold) * ENTRIES_PER_CHUNK)));
+            nUsedInLastChunk = 0;
+        }
+        CBlockIndexCold* pcold = new (vColdChunks.back() + nUsedInLastChunk) CBlockIndexCold();
+        CBlockIndex* pindex = new (vChunks.back() + nUsedInLastChunk) CBlockIndex(pcold, std::forward<Args>(args)...);
+        nUsedInLastChunk++;
+        return pindex;
+    }
+
+    //! Destroy every entry handed out by Create().
+    void Clear();
+
+    size_t size() const
+    {
+        return vChunks.empty() ? 0 : (vChunks.size() - 1) * ENTRIES_PER_CHUNK + nUsedInLastChunk;
+    }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -39,6 +39,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/fcntl.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
@@ -46,6 +47,14 @@
 #include <unistd.h>
 #endif
 
+#ifndef WIN32
+// Sockets are waited on with poll(), or epoll on Linux, neither of which limits descriptor numbers
+#define USE_POLL
+#ifdef __linux__
+#define USE_EPOLL
+#endif
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT 0
 #else
@@ -95,7 +104,7 @@ size_t strnlen( const char *start, size_t max_len);
 
 bool static inline IsSelectableSocket(SOCKET s)
 {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
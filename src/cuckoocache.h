@@ -0,0 +1,209 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_CUCKOOCACHE_H
+#define WISPR_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * Fixed size cache of elements, where each element can live in one of eight
+ * slots picked by eight hash functions. Inserting into a full set of slots
+ * moves the resident element to one of its other slots, up to a depth limit
+ * (cuckoo hashing).
+ *
+ * Slots are reclaimed by two mechanisms:
+ *  - contains() with erase set marks the slot as collectable, which only
+ *    touches an atomic flag so it is safe under a shared lock;
+ *  - every element belongs to a generation (epoch), and once most of the
+ *    current generation is still alive the older one is marked collectable
+ *    as a whole, so elements not looked up recently are the first to go.
+ *
+ * Lookups never modify the table, so any number of them can run at once.
+ * insert() modifies it and must not run concurrently with anything else.
+ */
+namespace CuckooCache
+{
+/** Vector of bits, each set and cleared atomically */
+class bit_packed_atomic_flags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> mem;
+
+public:
+    bit_packed_atomic_flags() = delete;
+
+    /** All flags start set */
+    explicit bit_packed_atomic_flags(uint32_t size)
+    {
+        size = (size + 7) / 8;
+        mem.reset(new std::atomic<uint8_t>[size]);
+        for (uint32_t i = 0; i < size; ++i)
+            mem[i].store(0xFF);
+    }
+
+    /** Reset to b set flags, not thread safe */
+    void setup(uint32_t b)
+    {
+        bit_packed_atomic_flags d(b);
+        std::swap(mem, d.mem);
+    }
+
+    void bit_set(uint32_t s) { mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed); }
+    void bit_unset(uint32_t s) { mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed); }
+    bool bit_is_set(uint32_t s) const { return (1 << (s & 7)) & mem[s >> 3].load(std::memory_order_relaxed); }
+};
+
+/**
+ * Hash must provide template <uint8_t n> uint32_t operator()(const Element&) const
+ * for n from 0 to 7, returning well distributed and independent values.
+ */
+template <typename Element, typename Hash>
+class cache
+{
+private:
+    std::vector<Element> table;
+    uint32_t size;
+    //! Set for slots that may be overwritten
+    mutable bit_packed_atomic_flags collection_flags;
+    //! Set for slots holding an element of the current generation
+    std::vector<bool> epoch_flags;
+    //! Inserts before the generation is checked again
+    uint32_t epoch_heuristic_counter;
+    //! Live elements of the current generation before a new one starts
+    uint32_t epoch_size;
+    //! Moves before an insert gives up and drops the last moved element
+    uint8_t depth_limit;
+    const Hash hash_function;
+
+    std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    {
+        // Map each 32 bit hash to [0, size) with a multiply and shift instead of a modulo
+        return {{(uint32_t)(((uint64_t)hash_function.template operator()<0>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<1>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<2>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<3>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<4>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<5>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<6>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<7>(e) * (uint64_t)size) >> 32)}};
+    }
+
+    static uint32_t invalid() { return ~(uint32_t)0; }
+
+    void allow_erase(uint32_t n) const { collection_flags.bit_set(n); }
+    void please_keep(uint32_t n) const { collection_flags.bit_unset(n); }
+
+    /** Start a new generation, making the old one collectable, once enough of the current one is alive */
+    void epoch_check()
+    {
+        if (epoch_heuristic_counter != 0) {
+            --epoch_heuristic_counter;
+            return;
+        }
+
+        uint32_t epoch_unused_count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            epoch_unused_count += epoch_flags[i] && !collection_flags.bit_is_set(i);
+
+        if (epoch_unused_count >= epoch_size) {
+            for (uint32_t i = 0; i < size; ++i) {
+                if (epoch_flags[i]) {
+                    epoch_flags[i] = false;
+                } else {
+                    allow_erase(i);
+                }
+            }
+            epoch_heuristic_counter = epoch_size;
+        } else {
+            // Check again once enough inserts could have filled the generation
+            epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16, epoch_size - std::min(epoch_size, epoch_unused_count)));
+        }
+    }
+
+public:
+    cache() : table(), size(), collection_flags(0), epoch_flags(), epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function() {}
+
+    /** Size the cache for new_size elements, dropping any content. Returns the number of elements it holds. */
+    uint32_t setup(uint32_t new_size)
+    {
+        // A depth of log2(size) keeps long move chains rare without failing inserts early
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
+        size = std::max<uint32_t>(2, new_size);
+        table.assign(size, Element());
+        collection_flags.setup(size);
+        epoch_flags.assign(size, false);
+        // Start a new generation at 45% of the capacity
+        epoch_size = std::max((uint32_t)1, (45 * size) / 100);
+        epoch_heuristic_counter = epoch_size;
+        return size;
+    }
+
+    /** Size the cache to use at most bytes of table memory */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(std::min<size_t>(bytes / sizeof(Element), ~(uint32_t)0 >> 1));
+    }
+
+    /** Add an element, evicting a collectable or, past the depth limit, an arbitrary one */
+    void insert(Element e)
+    {
+        epoch_check();
+        uint32_t last_loc = invalid();
+        bool last_epoch = true;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+
+        // Already present: keep it and bring it into the current generation
+        for (const uint32_t loc : locs) {
+            if (table[loc] == e) {
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+        }
+
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            for (const uint32_t loc : locs) {
+                if (!collection_flags.bit_is_set(loc))
+                    continue;
+                table[loc] = std::move(e);
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+
+            // Every slot taken: move out the element after the one moved last time, and place it instead
+            last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
+            std::swap(table[last_loc], e);
+            bool epoch = last_epoch;
+            last_epoch = epoch_flags[last_loc];
+            epoch_flags[last_loc] = epoch;
+
+            locs = compute_hashes(e);
+        }
+    }
+
+    /** Whether the element is in the cache, marking it collectable if erase is set */
+    bool contains(const Element& e, const bool erase) const
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (const uint32_t loc : locs) {
+            if (table[loc] == e) {
+                if (erase)
+                    allow_erase(loc);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+} // namespace CuckooCache
+
+#endif // WISPR_CUCKOOCACHE_H
@@ -5,6 +5,7 @@
 
 #include <boost/assign/list_of.hpp>
 
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "spork.h"
@@ -131,7 +132,7 @@ static bool SelectBlockFromCandidates(
         if(fModifierV2)
             hashProof = pindex->GetBlockHash();
         else
-            hashProof = pindex->hashProofOfStake;
+            hashProof = pindex->cold->hashProofOfStake;
 
         CDataStream ss(SER_GETHASH, 0);
         ss << hashProof << nStakeModifierPrev;
@@ -165,9 +166,9 @@ static bool SelectBlockFromCandidates(
 uint256 ComputeStakeModifier(const CBlockIndex *pindexPrev, const uint256 &kernel) {
     if (!pindexPrev)
         return 0;  // genesis block's modifier is 0
-//    LogPrintf("ComputeStakeModifier: kernel=%s, bnStakeModifierV2=%s\n", kernel.ToString().c_str(), pindexPrev->bnStakeModifierV2.ToString().c_str());
+//    LogPrintf("ComputeStakeModifier: kernel=%s, bnStakeModifierV2=%s\n", kernel.ToString().c_str(), pindexPrev->cold->bnStakeModifierV2.ToString().c_str());
     CDataStream ss(SER_GETHASH, 0);
-    ss << kernel << pindexPrev->bnStakeModifierV2;
+    ss << kernel << pindexPrev->cold->bnStakeModifierV2;
     uint256 hash = Hash(ss.begin(), ss.end());
 //    LogPrintf("ComputeStakeModifier: hash=%s\n", hash.ToString().c_str());
     return hash;
@@ -363,7 +364,7 @@ bool CheckStakeV1(unsigned int nTxPrevTime, const COutPoint &prevout,
     uint256 bnWeight = uint256(nValueIn);
     bnTarget *= bnWeight;
 
-    uint256 bnStakeModifierV2 = pindexPrev->bnStakeModifierV2;
+    uint256 bnStakeModifierV2 = pindexPrev->cold->bnStakeModifierV2;
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
     ss << bnStakeModifierV2;
@@ -374,49 +375,83 @@ bool CheckStakeV1(unsigned int nTxPrevTime, const COutPoint &prevout,
     return stakeTargetHitOld(hashProofOfStake, bnTarget);
 }
 
-bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake)
+CStakeKernel::CStakeKernel(const CDataStream& ssUniqueID, CAmount nValueIn, uint64_t nStakeModifier, const uint256& bnTargetPerCoinDay, unsigned int nTimeBlockFrom)
 {
-    if(Params().NetworkID() != CBaseChainParams::REGTEST) {
-        if (nTimeTx < nTimeBlockFrom)
-            return error("%s : nTime violation", __func__);
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << ssUniqueID;
+    hasherPrefix.Write((const unsigned char*)&ss[0], ss.size());
 
-        if (nTimeBlockFrom + GetStakeMinAge() > nTimeTx) // Min age requirement
-            return error("%s : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d",
-                         __func__, nTimeBlockFrom, GetStakeMinAge(), nTimeTx);
-    }
+    // Same weighting as stakeTargetHit()
+    bnTarget = (uint256(nValueIn) / 100) * bnTargetPerCoinDay;
+}
+
+uint256 CStakeKernel::GetHash(unsigned int nTimeTx) const
+{
+    // Double SHA-256, as Hash() over the serialized kernel
+    unsigned char time[4];
+    WriteLE32(time, nTimeTx);
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    CSHA256 hasher(hasherPrefix);
+    hasher.Write(time, sizeof(time)).Finalize(buf);
+
+    uint256 hash;
+    CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize(hash.begin());
+    return hash;
+}
+
+bool CStakeKernel::CheckHash(unsigned int nTimeTx, uint256& hashProofOfStake) const
+{
+    hashProofOfStake = GetHash(nTimeTx);
+    return hashProofOfStake < bnTarget;
+}
 
-    //grab difficulty
+bool SearchStakeKernels(const std::list<std::unique_ptr<CStakeInput> >& listInputs, unsigned int nBits, unsigned int nTimeTx, std::vector<CStakeKernelHit>& vHits, int& nAttempts)
+{
     uint256 bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
-    //grab stake modifier
-    uint64_t nStakeModifier = 0;
-    if (!stakeInput->GetModifier(nStakeModifier))
-        return error("%s : failed to get kernel stake modifier", __func__);
-
-    bool fSuccess = false;
-    unsigned int nTryTime = 0;
     int nHeightStart = chainActive.Height();
     int nHashDrift = 60;
-    CDataStream ssUniqueID = stakeInput->GetUniqueness();
-    CAmount nValueIn = stakeInput->GetValue();
-    for (int i = 0; i < nHashDrift; i++) //iterate the hashing
-    {
-        //new block came in, move on
-        if (chainActive.Height() != nHeightStart)
+    bool fSuccess = true;
+    for (const std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
+        //new block came in, the kernels are stale
+        if (chainActive.Height() != nHeightStart) {
+            fSuccess = false;
             break;
+        }
 
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
+        CBlockIndex* pindex = stakeInput->GetIndexFrom();
+        if (!pindex || pindex->nHeight < 1) {
+            LogPrintf("%s : no pindexfrom\n", __func__);
+            continue;
+        }
 
-        // if stake hash does not meet the target then continue to next iteration
-        if (!CheckStakeV2(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime, hashProofOfStake))
+        unsigned int nTimeBlockFrom = pindex->GetBlockTime();
+        if (Params().NetworkID() != CBaseChainParams::REGTEST) {
+            if (nTimeTx < nTimeBlockFrom || nTimeBlockFrom + GetStakeMinAge() > nTimeTx) {
+                LogPrint("staking", "%s : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d\n",
+                         __func__, nTimeBlockFrom, GetStakeMinAge(), nTimeTx);
+                continue;
+            }
+        }
+
+        uint64_t nStakeModifier = 0;
+        if (!stakeInput->GetModifier(nStakeModifier)) {
+            LogPrintf("%s : failed to get kernel stake modifier\n", __func__);
             continue;
+        }
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
-        //LogPrintf("%s : hashproof=%s\n", __func__, hashProofOfStake.GetHex());
-        nTimeTx = nTryTime;
-        break;
+        nAttempts++;
+        CStakeKernel kernel(stakeInput->GetUniqueness(), stakeInput->GetValue(), nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom);
+        for (int i = 0; i < nHashDrift; i++) {
+            CStakeKernelHit hit;
+            hit.nTimeTx = nTimeTx + nHashDrift - i;
+            if (kernel.CheckHash(hit.nTimeTx, hit.hashProofOfStake)) {
+                hit.stakeInput = stakeInput.get();
+                vHits.push_back(hit);
+                break;
+            }
+        }
     }
 
     mapHashedBlocks.clear();
@@ -549,8 +584,8 @@ unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
     CDataStream ss(SER_GETHASH, 0);
     if (pindex->pprev)
-        ss << pindex->pprev->nStakeModifierChecksum;
-    ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
+        ss << pindex->pprev->cold->nStakeModifierChecksum;
+    ss << pindex->nFlags << pindex->cold->hashProofOfStake << pindex->nStakeModifier;
     uint256 hashChecksum = Hash(ss.begin(), ss.end());
     hashChecksum >>= (256 - 32);
     return hashChecksum.Get64();
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "crypto/sha256.h"
 #include "main.h"
 #include "stakeinput.h"
 
@@ -36,7 +37,36 @@ bool CheckStakeV1(unsigned int nTxPrevTime, const COutPoint &prevout,
                   unsigned int nBits, bool fDebug);
 bool stakeTargetHit(const uint256& hashProofOfStake, const int64_t& nValueIn, const uint256& bnTargetPerCoinDay);
 bool stakeTargetHitOld(const uint256& hashProofOfStake, const uint256& bnTargetPerCoinDay);
-bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake);
+/**
+ * The V2 kernel hash of one stake input with everything but the transaction time already fed to
+ * the hasher, so trying a time slot only hashes the time itself. Gives the same hash as CheckStakeV2.
+ */
+class CStakeKernel
+{
+private:
+    //! Hasher state after the stake modifier, the time of the origin block and the uniqueness of the input
+    CSHA256 hasherPrefix;
+    //! Target per coin day weighted by the value of the input
+    uint256 bnTarget;
+
+public:
+    CStakeKernel(const CDataStream& ssUniqueID, CAmount nValueIn, uint64_t nStakeModifier, const uint256& bnTargetPerCoinDay, unsigned int nTimeBlockFrom);
+
+    uint256 GetHash(unsigned int nTimeTx) const;
+    bool CheckHash(unsigned int nTimeTx, uint256& hashProofOfStake) const;
+};
+
+/** A stake input whose kernel meets the target, with the time slot that hit it */
+struct CStakeKernelHit
+{
+    CStakeInput* stakeInput;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+};
+
+// Search the time slots of every stake input in one pass and return the inputs that hit the target,
+// in the order of listInputs. Fails if the tip changed during the search.
+bool SearchStakeKernels(const std::list<std::unique_ptr<CStakeInput> >& listInputs, unsigned int nBits, unsigned int nTimeTx, std::vector<CStakeKernelHit>& vHits, int& nAttempts);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
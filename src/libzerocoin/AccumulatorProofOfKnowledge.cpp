@@ -38,9 +38,9 @@ AccumulatorProofOfKnowledge::AccumulatorProofOfKnowledge(const AccumulatorAndPro
     CBigNum r_2 = CBigNum::randBignum(aM_4);
     CBigNum r_3 = CBigNum::randBignum(aM_4);
 
-	this->C_e = g_n.pow_mod(e, params->accumulatorModulus) * h_n.pow_mod(r_1, params->accumulatorModulus);
-	this->C_u = witness.getValue() * h_n.pow_mod(r_2, params->accumulatorModulus);
-	this->C_r = g_n.pow_mod(r_2, params->accumulatorModulus) * h_n.pow_mod(r_3, params->accumulatorModulus);
+	this->C_e = params->qrnPowG(e) * params->qrnPowH(r_1);
+	this->C_u = witness.getValue() * params->qrnPowH(r_2);
+	this->C_r = params->qrnPowG(r_2) * params->qrnPowH(r_3);
 
     CBigNum r_alpha = CBigNum::randBignum(params->maxCoinValue * aR);
 	if(!(CBigNum::randBignum(CBigNum(3)) % 2)) {
@@ -75,14 +75,17 @@ AccumulatorProofOfKnowledge::AccumulatorProofOfKnowledge(const AccumulatorAndPro
 		r_delta = 0-r_delta;
 	}
 
-	this->st_1 = (sg.pow_mod(r_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(r_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	this->st_2 = (((commitmentToCoin.getCommitmentValue() * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(r_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(r_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	this->st_3 = ((sg * commitmentToCoin.getCommitmentValue()).pow_mod(r_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(r_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	const IntegerGroupParams& pokGroup = params->accumulatorPoKCommitmentGroup;
 
-	this->t_1 = (h_n.pow_mod(r_zeta, params->accumulatorModulus) * g_n.pow_mod(r_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	this->t_2 = (h_n.pow_mod(r_eta, params->accumulatorModulus) * g_n.pow_mod(r_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	this->t_3 = (C_u.pow_mod(r_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(r_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	this->t_4 = (C_r.pow_mod(r_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(r_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(r_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	this->st_1 = (pokGroup.powG(r_alpha) * pokGroup.powH(r_phi)) % pokGroup.modulus;
+	this->st_2 = (((commitmentToCoin.getCommitmentValue() * sg.inverse(pokGroup.modulus)).pow_mod(r_gamma, pokGroup.modulus)) * pokGroup.powH(r_psi)) % pokGroup.modulus;
+	this->st_3 = ((sg * commitmentToCoin.getCommitmentValue()).pow_mod(r_sigma, pokGroup.modulus) * pokGroup.powH(r_xi)) % pokGroup.modulus;
+
+	// (h_n^-1)^x = h_n^-x
+	this->t_1 = (params->qrnPowH(r_zeta) * params->qrnPowG(r_epsilon)) % params->accumulatorModulus;
+	this->t_2 = (params->qrnPowH(r_eta) * params->qrnPowG(r_alpha)) % params->accumulatorModulus;
+	this->t_3 = (C_u.pow_mod(r_alpha, params->accumulatorModulus) * params->qrnPowH(-r_beta)) % params->accumulatorModulus;
+	this->t_4 = (C_r.pow_mod(r_alpha, params->accumulatorModulus) * params->qrnPowH(-r_delta) * params->qrnPowG(-r_beta)) % params->accumulatorModulus;
 
 	CHashWriter hasher(0,0);
 	hasher << *params << sg << sh << g_n << h_n << commitmentToCoin.getCommitmentValue() << C_e << C_u << C_r << st_1 << st_2 << st_3 << t_1 << t_2 << t_3 << t_4;
@@ -118,14 +121,19 @@ bool AccumulatorProofOfKnowledge:: Verify(const libzerocoin::Accumulator& a, con
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
+	const IntegerGroupParams& pokGroup = params->accumulatorPoKCommitmentGroup;
+	const CBigNum& accModulus = params->accumulatorModulus;
+
+	// Powers of the fixed generators come from the precomputed tables; the remaining
+	// products of variable bases share one multi-exponentiation. (h_n^-1)^x = h_n^-x
+	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, pokGroup.modulus) * pokGroup.powG(s_alpha) * pokGroup.powH(s_phi)) % pokGroup.modulus;
+	CBigNum st_2_prime = (pokGroup.powG(c) * (valueOfCommitmentToCoin * sg.inverse(pokGroup.modulus)).pow_mod(s_gamma, pokGroup.modulus) * pokGroup.powH(s_psi)) % pokGroup.modulus;
+	CBigNum st_3_prime = (pokGroup.powG(c) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, pokGroup.modulus) * pokGroup.powH(s_xi)) % pokGroup.modulus;
 
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	CBigNum t_1_prime = (C_r.pow_mod(c, accModulus) * params->qrnPowH(s_zeta) * params->qrnPowG(s_epsilon)) % accModulus;
+	CBigNum t_2_prime = (C_e.pow_mod(c, accModulus) * params->qrnPowH(s_eta) * params->qrnPowG(s_alpha)) % accModulus;
+	CBigNum t_3_prime = (CBigNum::multi_pow_mod({{a.getValue(), c}, {C_u, s_alpha}}, accModulus) * params->qrnPowH(-s_beta)) % accModulus;
+	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, accModulus) * params->qrnPowH(-s_delta) * params->qrnPowG(-s_beta)) % accModulus;
 
 	bool result_st1 = (st_1 == st_1_prime);
 	bool result_st2 = (st_2 == st_2_prime);
@@ -38,11 +38,45 @@ IntegerGroupParams::IntegerGroupParams() {
 	this->initialized = false;
 }
 
+/**
+ * Returns the fixed-base table for base mod m, building it the first time.
+ * Concurrent first callers may each build a table; one of them is kept.
+ */
+static std::shared_ptr<const CBigNumFixedBase> GetFixedBaseTable(std::shared_ptr<const CBigNumFixedBase>& table,
+        const CBigNum& base, const CBigNum& m, unsigned int nMaxExpBits) {
+	std::shared_ptr<const CBigNumFixedBase> ptable = std::atomic_load(&table);
+	if (!ptable || ptable->getBase() != base || ptable->getModulus() != m) {
+		ptable = std::make_shared<const CBigNumFixedBase>(base, m, nMaxExpBits);
+		std::atomic_store(&table, ptable);
+	}
+	return ptable;
+}
+
+CBigNum IntegerGroupParams::powG(const CBigNum& e) const {
+	return GetFixedBaseTable(gTable, g, modulus, groupOrder.bitSize())->pow_mod(e % groupOrder);
+}
+
+CBigNum IntegerGroupParams::powH(const CBigNum& e) const {
+	return GetFixedBaseTable(hTable, h, modulus, groupOrder.bitSize())->pow_mod(e % groupOrder);
+}
+
+// Exponents in the accumulator proof are at most a few hundred bits longer than the
+// modulus, so twice its size covers all of them
+CBigNum AccumulatorAndProofParams::qrnPowG(const CBigNum& e) const {
+	return GetFixedBaseTable(qrnGTable, accumulatorQRNCommitmentGroup.g, accumulatorModulus,
+	                         2 * accumulatorModulus.bitSize())->pow_mod(e);
+}
+
+CBigNum AccumulatorAndProofParams::qrnPowH(const CBigNum& e) const {
+	return GetFixedBaseTable(qrnHTable, accumulatorQRNCommitmentGroup.h, accumulatorModulus,
+	                         2 * accumulatorModulus.bitSize())->pow_mod(e);
+}
+
 CBigNum IntegerGroupParams::randomElement() const {
 	// The generator of the group raised
 	// to a random number less than the order of the group
 	// provides us with a uniformly distributed random number.
-	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
+	return powG(CBigNum::randBignum(this->groupOrder));
 }
 
 } /* namespace libzerocoin */
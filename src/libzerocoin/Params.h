@@ -14,6 +14,8 @@
 #ifndef PARAMS_H_
 #define PARAMS_H_
 
+#include <memory>
+
 #include "bignum.h"
 #include "ZerocoinDefines.h"
 
@@ -32,6 +34,17 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Fixed-base exponentiation of the generators: g^e mod modulus
+	 * and h^e mod modulus. The exponent is reduced mod groupOrder and
+	 * the result is read from a precomputed table, built once on first
+	 * use and shared by all threads using these parameters.
+	 * @param e the exponent
+	 */
+	CBigNum powG(const CBigNum& e) const;
+	CBigNum powH(const CBigNum& e) const;
+
 	bool initialized;
 
 	/**
@@ -64,6 +77,10 @@ public:
 		    READWRITE(modulus);
 		    READWRITE(groupOrder);
 	}	
+
+private:
+	mutable std::shared_ptr<const CBigNumFixedBase> gTable;
+	mutable std::shared_ptr<const CBigNumFixedBase> hTable;
 };
 
 class AccumulatorAndProofParams {
@@ -88,6 +105,16 @@ public:
 
 	//AccumulatorAndProofParams(CBigNum accumulatorModulus);
 
+	/**
+	 * Fixed-base exponentiation of the QRN commitment generators:
+	 * g^e mod accumulatorModulus and h^e mod accumulatorModulus, read
+	 * from precomputed tables built once on first use.
+	 * The order of QR_N is hidden, so the exponent is not reduced.
+	 * @param e the exponent
+	 */
+	CBigNum qrnPowG(const CBigNum& e) const;
+	CBigNum qrnPowH(const CBigNum& e) const;
+
 	bool initialized;
 
 	/**
@@ -151,6 +178,10 @@ public:
 	    READWRITE(k_prime);
 	    READWRITE(k_dprime);
   }
+
+private:
+	mutable std::shared_ptr<const CBigNumFixedBase> qrnGTable;
+	mutable std::shared_ptr<const CBigNumFixedBase> qrnHTable;
 };
 
 class ZerocoinParams {
@@ -145,6 +145,18 @@ public:
      */
     CBigNum pow_mod(const CBigNum& e, const CBigNum& m) const;
 
+    /**
+     * simultaneous modular multi-exponentiation: prod(b_i^e_i) mod m
+     * All terms share a single squaring chain (Straus/Shamir interleaving),
+     * so a product of k powers costs roughly one pow_mod plus the window
+     * multiplications instead of k independent exponentiations.
+     * Negative exponents are handled as in pow_mod: g^-x = (g^-1)^x.
+     * Not constant time: use only on public values (e.g. proof verification).
+     * @param terms list of (base, exponent) pairs
+     * @param m modulus
+     */
+    static CBigNum multi_pow_mod(const std::vector<std::pair<CBigNum, CBigNum> >& terms, const CBigNum& m);
+
     /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -208,6 +220,53 @@ public:
     friend inline bool operator>=(const CBigNum& a, const CBigNum& b);
     friend inline bool operator<(const CBigNum& a, const CBigNum& b);
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
+    friend class CBigNumFixedBase;
+};
+
+/**
+ * Fixed-base exponentiation table for a base that is raised to many
+ * different exponents (e.g. the zerocoin group generators).
+ * Stores base^(d * 2^(w*j)) mod m for every w-bit window j and digit d,
+ * so base^e costs one modular multiplication per window of e and no
+ * squarings. The table is immutable once built and can be shared
+ * between threads.
+ */
+class CBigNumFixedBase
+{
+public:
+    static const unsigned int WINDOW_BITS = 4;
+    static const unsigned int WINDOW_ENTRIES = 1 << WINDOW_BITS;
+
+    /**
+     * @param base the fixed base
+     * @param m modulus
+     * @param nMaxExpBits largest exponent size (in bits) served from the table
+     */
+    CBigNumFixedBase(const CBigNum& base, const CBigNum& m, unsigned int nMaxExpBits);
+
+    /**
+     * modular exponentiation: base^e mod m
+     * Exponents longer than the table fall back to CBigNum::pow_mod.
+     * @param e exponent
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+
+    const CBigNum& getBase() const { return base; }
+    const CBigNum& getModulus() const { return modulus; }
+
+private:
+    CBigNum base;
+    CBigNum modulus;
+    unsigned int nMaxBits;
+#if defined(USE_NUM_OPENSSL)
+    std::vector<CBigNum> vTable;
+#endif
+#if defined(USE_NUM_GMP)
+    // window entries are stored as fixed-size limb arrays, so that
+    // mpn_sec_tabselect can read them without secret-dependent access
+    mp_size_t nLimbs;
+    std::vector<mp_limb_t> vTable;
+#endif
 };
 
 #if defined(USE_NUM_OPENSSL)
@@ -4,6 +4,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <utility>
 
 
@@ -249,6 +250,146 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+/**
+ * Window width for multi_pow_mod, chosen from the longest exponent:
+ * wider windows mean fewer multiplications but larger per-base tables.
+ */
+static unsigned int MultiExpWindowBits(size_t nMaxBits)
+{
+    if (nMaxBits > 768) return 5;
+    if (nMaxBits > 256) return 4;
+    if (nMaxBits > 32) return 3;
+    return 1;
+}
+
+/**
+ * simultaneous modular multi-exponentiation: prod(b_i^e_i) mod m
+ * @param terms list of (base, exponent) pairs
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<std::pair<CBigNum, CBigNum> >& terms, const CBigNum& m)
+{
+    // A single power is faster through the backend's own exponentiation
+    if (terms.size() == 1)
+        return terms[0].first.pow_mod(terms[0].second, m);
+
+    // Normalize every term to a reduced base and a non-negative exponent
+    std::vector<CBigNum> vBases;
+    std::vector<CBigNum> vExps;
+    size_t nMaxBits = 0;
+    for (const auto& term : terms) {
+        if (mpz_sgn(term.second.bn) == 0)
+            continue;
+        CBigNum base, exp;
+        mpz_mod(base.bn, term.first.bn, m.bn);
+        if (mpz_sgn(term.second.bn) < 0) {
+            // g^-x = (g^-1)^x
+            if (!mpz_invert(base.bn, base.bn, m.bn))
+                throw bignum_error("CBigNum::multi_pow_mod : mpz_invert failed on negative exponent");
+            mpz_neg(exp.bn, term.second.bn);
+        } else {
+            mpz_set(exp.bn, term.second.bn);
+        }
+        nMaxBits = std::max(nMaxBits, mpz_sizeinbase(exp.bn, 2));
+        vBases.push_back(base);
+        vExps.push_back(exp);
+    }
+
+    // Precompute b_i^d mod m for every window value d in [1, 2^w)
+    const unsigned int nWindow = MultiExpWindowBits(nMaxBits);
+    const size_t nTableSize = (1u << nWindow) - 1;
+    std::vector<std::vector<CBigNum> > vTables(vBases.size(), std::vector<CBigNum>(nTableSize));
+    CBigNum tmp;
+    for (size_t i = 0; i < vBases.size(); i++) {
+        std::vector<CBigNum>& table = vTables[i];
+        table[0] = vBases[i];
+        for (size_t d = 1; d < nTableSize; d++) {
+            mpz_mul(tmp.bn, table[d - 1].bn, vBases[i].bn);
+            mpz_mod(table[d].bn, tmp.bn, m.bn);
+        }
+    }
+
+    // Interleave all exponents over one shared squaring chain, most significant window first
+    CBigNum ret;
+    mpz_set_ui(ret.bn, 1);
+    mpz_mod(ret.bn, ret.bn, m.bn);
+    bool fStarted = false;
+    for (size_t nPos = (nMaxBits + nWindow - 1) / nWindow; nPos-- > 0; ) {
+        if (fStarted) {
+            for (unsigned int s = 0; s < nWindow; s++) {
+                mpz_mul(tmp.bn, ret.bn, ret.bn);
+                mpz_mod(ret.bn, tmp.bn, m.bn);
+            }
+        }
+        for (size_t i = 0; i < vExps.size(); i++) {
+            unsigned int d = 0;
+            for (unsigned int s = nWindow; s-- > 0; )
+                d = (d << 1) | mpz_tstbit(vExps[i].bn, nPos * nWindow + s);
+            if (d == 0)
+                continue;
+            mpz_mul(tmp.bn, ret.bn, vTables[i][d - 1].bn);
+            mpz_mod(ret.bn, tmp.bn, m.bn);
+            fStarted = true;
+        }
+    }
+    return ret;
+}
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& m, unsigned int nMaxExpBits) :
+    base(baseIn), modulus(m), nMaxBits(nMaxExpBits)
+{
+    nLimbs = mpz_size(m.bn);
+    const size_t nWindows = (nMaxBits + WINDOW_BITS - 1) / WINDOW_BITS;
+    vTable.assign(nWindows * WINDOW_ENTRIES * nLimbs, 0);
+
+    // window j holds (base^(2^(w*j)))^d for d in [0, 2^w)
+    CBigNum windowBase, entry, tmp;
+    mpz_mod(windowBase.bn, base.bn, m.bn);
+    for (size_t j = 0; j < nWindows; j++) {
+        mpz_set_ui(entry.bn, 1);
+        for (unsigned int d = 0; d < WINDOW_ENTRIES; d++) {
+            mp_limb_t* pEntry = &vTable[(j * WINDOW_ENTRIES + d) * nLimbs];
+            mpn_copyi(pEntry, mpz_limbs_read(entry.bn), mpz_size(entry.bn));
+            mpz_mul(tmp.bn, entry.bn, windowBase.bn);
+            mpz_mod(entry.bn, tmp.bn, m.bn);
+        }
+        // entry is now windowBase^(2^w), the base of the next window
+        mpz_swap(windowBase.bn, entry.bn);
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    if (mpz_sgn(e.bn) < 0) {
+        // g^-x = (g^x)^-1
+        CBigNum ret = pow_mod(-e);
+        if (!mpz_invert(ret.bn, ret.bn, modulus.bn))
+            throw bignum_error("CBigNumFixedBase::pow_mod : mpz_invert failed on negative exponent");
+        return ret;
+    }
+    if (mpz_sizeinbase(e.bn, 2) > nMaxBits)
+        return base.pow_mod(e, modulus);
+
+    // Entries are picked with mpn_sec_tabselect and multiplied in even for a zero
+    // digit, so the memory access pattern only depends on the exponent length.
+    const size_t nWindows = (mpz_sizeinbase(e.bn, 2) + WINDOW_BITS - 1) / WINDOW_BITS;
+    std::vector<mp_limb_t> vEntry(nLimbs);
+    CBigNum ret, tmp;
+    mpz_set_ui(ret.bn, 1);
+    mpz_mod(ret.bn, ret.bn, modulus.bn);
+    for (size_t j = 0; j < nWindows; j++) {
+        mp_limb_t d = 0;
+        for (unsigned int s = WINDOW_BITS; s-- > 0; )
+            d = (d << 1) | mpz_tstbit(e.bn, j * WINDOW_BITS + s);
+        mpn_sec_tabselect(vEntry.data(), &vTable[j * WINDOW_ENTRIES * nLimbs], nLimbs, WINDOW_ENTRIES, d);
+        mpz_t entry;
+        mpz_roinit_n(entry, vEntry.data(), nLimbs);
+        mpz_mul(tmp.bn, ret.bn, entry);
+        mpz_mod(ret.bn, tmp.bn, modulus.bn);
+    }
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -4,6 +4,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <utility>
 
 
@@ -385,6 +386,166 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+/**
+ * Window width for multi_pow_mod, chosen from the longest exponent:
+ * wider windows mean fewer multiplications but larger per-base tables.
+ */
+static unsigned int MultiExpWindowBits(int nMaxBits)
+{
+    if (nMaxBits > 768) return 5;
+    if (nMaxBits > 256) return 4;
+    if (nMaxBits > 32) return 3;
+    return 1;
+}
+
+/** RAII holder for a Montgomery context */
+class CAutoBN_MONT_CTX
+{
+    BN_MONT_CTX* pmont;
+
+public:
+    CAutoBN_MONT_CTX(const BIGNUM* m, BN_CTX* pctx)
+    {
+        pmont = BN_MONT_CTX_new();
+        if (pmont == nullptr || !BN_MONT_CTX_set(pmont, m, pctx)) {
+            BN_MONT_CTX_free(pmont);
+            throw bignum_error("CAutoBN_MONT_CTX : BN_MONT_CTX_set failed");
+        }
+    }
+    ~CAutoBN_MONT_CTX() { BN_MONT_CTX_free(pmont); }
+
+    operator BN_MONT_CTX*() { return pmont; }
+};
+
+/**
+ * simultaneous modular multi-exponentiation: prod(b_i^e_i) mod m
+ * @param terms list of (base, exponent) pairs
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<std::pair<CBigNum, CBigNum> >& terms, const CBigNum& m)
+{
+    // A single power is faster through the backend's own exponentiation
+    if (terms.size() == 1)
+        return terms[0].first.pow_mod(terms[0].second, m);
+
+    // Montgomery multiplication needs an odd modulus
+    if (!BN_is_odd(m.bn)) {
+        CBigNum ret = CBigNum(1) % m;
+        for (const auto& term : terms)
+            ret = ret.mul_mod(term.first.pow_mod(term.second, m), m);
+        return ret;
+    }
+
+    CAutoBN_CTX pctx;
+    CAutoBN_MONT_CTX mont(m.bn, pctx);
+
+    // Normalize every term to a base in Montgomery form and a non-negative exponent
+    std::vector<CBigNum> vBases;
+    std::vector<CBigNum> vExps;
+    int nMaxBits = 0;
+    for (const auto& term : terms) {
+        if (BN_is_zero(term.second.bn))
+            continue;
+        CBigNum base = term.first % m;
+        CBigNum exp = term.second;
+        if (BN_is_negative(exp.bn)) {
+            // g^-x = (g^-1)^x
+            base = base.inverse(m);
+            BN_set_negative(exp.bn, 0);
+        }
+        if (!BN_to_montgomery(base.bn, base.bn, mont, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_to_montgomery failed");
+        nMaxBits = std::max(nMaxBits, BN_num_bits(exp.bn));
+        vBases.push_back(base);
+        vExps.push_back(exp);
+    }
+
+    // Precompute b_i^d mod m for every window value d in [1, 2^w)
+    const unsigned int nWindow = MultiExpWindowBits(nMaxBits);
+    const size_t nTableSize = (1u << nWindow) - 1;
+    std::vector<std::vector<CBigNum> > vTables(vBases.size(), std::vector<CBigNum>(nTableSize));
+    for (size_t i = 0; i < vBases.size(); i++) {
+        std::vector<CBigNum>& table = vTables[i];
+        table[0] = vBases[i];
+        for (size_t d = 1; d < nTableSize; d++) {
+            if (!BN_mod_mul_montgomery(table[d].bn, table[d - 1].bn, vBases[i].bn, mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        }
+    }
+
+    // Interleave all exponents over one shared squaring chain, most significant window first
+    CBigNum ret = CBigNum(1);
+    if (!BN_to_montgomery(ret.bn, ret.bn, mont, pctx))
+        throw bignum_error("CBigNum::multi_pow_mod : BN_to_montgomery failed");
+    bool fStarted = false;
+    for (int nPos = (nMaxBits + nWindow - 1) / nWindow; nPos-- > 0; ) {
+        if (fStarted) {
+            for (unsigned int s = 0; s < nWindow; s++) {
+                if (!BN_mod_mul_montgomery(ret.bn, ret.bn, ret.bn, mont, pctx))
+                    throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+            }
+        }
+        for (size_t i = 0; i < vExps.size(); i++) {
+            unsigned int d = 0;
+            for (unsigned int s = nWindow; s-- > 0; )
+                d = (d << 1) | (BN_is_bit_set(vExps[i].bn, nPos * nWindow + s) ? 1 : 0);
+            if (d == 0)
+                continue;
+            if (!BN_mod_mul_montgomery(ret.bn, ret.bn, vTables[i][d - 1].bn, mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+            fStarted = true;
+        }
+    }
+    if (!BN_from_montgomery(ret.bn, ret.bn, mont, pctx))
+        throw bignum_error("CBigNum::multi_pow_mod : BN_from_montgomery failed");
+    return ret;
+}
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& m, unsigned int nMaxExpBits) :
+    base(baseIn), modulus(m), nMaxBits(nMaxExpBits)
+{
+    const size_t nWindows = (nMaxBits + WINDOW_BITS - 1) / WINDOW_BITS;
+    vTable.resize(nWindows * WINDOW_ENTRIES);
+
+    // window j holds (base^(2^(w*j)))^d for d in [0, 2^w)
+    CAutoBN_CTX pctx;
+    CBigNum windowBase = base % m;
+    for (size_t j = 0; j < nWindows; j++) {
+        CBigNum entry = CBigNum(1) % m;
+        for (unsigned int d = 0; d < WINDOW_ENTRIES; d++) {
+            vTable[j * WINDOW_ENTRIES + d] = entry;
+            if (!BN_mod_mul(entry.bn, entry.bn, windowBase.bn, m.bn, pctx))
+                throw bignum_error("CBigNumFixedBase : BN_mod_mul failed");
+        }
+        // entry is now windowBase^(2^w), the base of the next window
+        windowBase = entry;
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    if (BN_is_negative(e.bn)) {
+        // g^-x = (g^x)^-1
+        return pow_mod(-e).inverse(modulus);
+    }
+    if ((unsigned int)BN_num_bits(e.bn) > nMaxBits)
+        return base.pow_mod(e, modulus);
+
+    CAutoBN_CTX pctx;
+    const int nWindows = (BN_num_bits(e.bn) + WINDOW_BITS - 1) / WINDOW_BITS;
+    CBigNum ret = CBigNum(1) % modulus;
+    for (int j = 0; j < nWindows; j++) {
+        unsigned int d = 0;
+        for (unsigned int s = WINDOW_BITS; s-- > 0; )
+            d = (d << 1) | (BN_is_bit_set(e.bn, j * WINDOW_BITS + s) ? 1 : 0);
+        if (d == 0)
+            continue;
+        if (!BN_mod_mul(ret.bn, ret.bn, vTable[j * WINDOW_ENTRIES + d].bn, modulus.bn, pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod : BN_mod_mul failed");
+    }
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -7,111 +7,188 @@
 #include "lightzwspthread.h"
 #include "main.h"
 
+bool CLightWorker::addWitWork(const CGenWit& wit) {
+    if (!isWorkerRunning) {
+        LogPrintf("%s not running trying to add wit work \n", "wispr-light-thread");
+        return false;
+    }
+
+    // Keep the peer alive until its request is answered
+    {
+        LOCK(cs_vNodes);
+        wit.getPfrom()->AddRef();
+    }
+
+    NodeId nodeId = wit.getPfrom()->GetId();
+    {
+        boost::unique_lock<boost::mutex> lock(cs_requests);
+        auto it = mapPeerRequests.find(nodeId);
+        int nPeerRequests = (it == mapPeerRequests.end() ? 0 : it->second);
+        if (requestsQueue.size() < MAX_LIGHT_ZWSP_QUEUE_SIZE && nPeerRequests < MAX_LIGHT_ZWSP_REQUESTS_PER_PEER) {
+            mapPeerRequests[nodeId] = nPeerRequests + 1;
+            requestsQueue.push_back(wit);
+            condRequests.notify_one();
+            return true;
+        }
+    }
+
+    LogPrint("zero", "%s queue full, rejecting work from peer=%d\n", "wispr-light-thread", nodeId);
+    LOCK(cs_vNodes);
+    wit.getPfrom()->Release();
+    return false;
+}
+
+std::vector<CGenWit> CLightWorker::popWork() {
+    boost::unique_lock<boost::mutex> lock(cs_requests);
+    while (requestsQueue.empty())
+        condRequests.wait(lock);
+
+    // Round robin between peers: the oldest request of the next peer after the last one served
+    auto itFirst = requestsQueue.begin();
+    NodeId nNextPeer = -1;
+    for (auto it = requestsQueue.begin(); it != requestsQueue.end(); ++it) {
+        NodeId nodeId = it->getPfrom()->GetId();
+        if (nodeId > nLastPeerServed && (nNextPeer == -1 || nodeId < nNextPeer)) {
+            nNextPeer = nodeId;
+            itFirst = it;
+        }
+    }
+    nLastPeerServed = itFirst->getPfrom()->GetId();
+
+    // Join every request with the same denomination and starting height into one calculation
+    std::vector<CGenWit> vWork;
+    vWork.push_back(*itFirst);
+    requestsQueue.erase(itFirst);
+    for (auto it = requestsQueue.begin(); it != requestsQueue.end() && vWork.size() < MAX_LIGHT_ZWSP_BATCH_SIZE;) {
+        if (it->getDen() == vWork.front().getDen() && it->getStartingHeight() == vWork.front().getStartingHeight()) {
+            vWork.push_back(*it);
+            it = requestsQueue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const CGenWit& wit : vWork) {
+        auto it = mapPeerRequests.find(wit.getPfrom()->GetId());
+        if (--it->second == 0)
+            mapPeerRequests.erase(it);
+    }
+
+    return vWork;
+}
+
 /****** Thread ********/
 void CLightWorker::ThreadLightZWSPSimplified() {
     RenameThread("wispr-light-thread");
-    isWorkerRunning = true;
     while (true) {
-        try {
 
-            // Take a breath between requests.. TODO: Add processor usage check here
-            MilliSleep(2000);
+        // Take a breath between requests.. TODO: Add processor usage check here
+        MilliSleep(2000);
 
-            // TODO: Future: join several similar requests into one calculation if the filter and denom match..
-            CGenWit genWit = requestsQueue.pop();
-            LogPrintf("%s pop work for %s \n\n", "wispr-light-thread", genWit.toString());
+        std::vector<CGenWit> vWork = popWork();
+        // Every popped request holds a reference to its peer, so each one is answered exactly once
+        unsigned int nAnswered = 0;
+        try {
+            const CGenWit& genWit = vWork.front();
+            LogPrintf("%s pop work for %s, %d requests \n\n", "wispr-light-thread", genWit.toString(), vWork.size());
 
             libzerocoin::ZerocoinParams *params = Params().Zerocoin_Params(false);
             CBlockIndex *pIndex = chainActive[genWit.getStartingHeight()];
-            if (!pIndex) {
-                // Rejects only the failed height
-                rejectWork(genWit, genWit.getStartingHeight(), NON_DETERMINED);
-            } else {
-                LogPrintf("%s calculating work for %s \n\n", "wispr-light-thread", genWit.toString());
-                int blockHeight = pIndex->nHeight;
-                if (blockHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT()) {
-
-                    // TODO: The protocol actually doesn't care about the Accumulator..
-                    libzerocoin::Accumulator accumulator(params, genWit.getDen(), genWit.getAccWitValue());
-                    libzerocoin::PublicCoin temp(params);
-                    libzerocoin::AccumulatorWitness witness(params, accumulator, temp);
-                    std::string strFailReason;
-                    int nMintsAdded = 0;
-                    CZerocoinSpendReceipt receipt;
-
-                    std::list<CBigNum> ret;
-                    int heightStop;
-
-                    bool res;
-                    try {
-
-                        res = CalculateAccumulatorWitnessFor(
-                                params,
-                                blockHeight,
-                                COMP_MAX_AMOUNT,
-                                genWit.getDen(),
-                                genWit.getFilter(),
-                                accumulator,
-                                witness,
-                                nMintsAdded,
-                                strFailReason,
-                                ret,
-                                heightStop
-                        );
-
-                    } catch (NotEnoughMintsException e) {
-                        LogPrintStr(std::string("ThreadLightZWSPSimplified: ") + e.message + "\n");
-                        rejectWork(genWit, blockHeight, NOT_ENOUGH_MINTS);
+            if (!pIndex || pIndex->nHeight < Params().NEW_PROTOCOLS_STARTHEIGHT()) {
+                for (; nAnswered < vWork.size(); nAnswered++)
+                    rejectWork(vWork[nAnswered], NON_DETERMINED);
+                continue;
+            }
+
+            LogPrintf("%s calculating work for %s \n\n", "wispr-light-thread", genWit.toString());
+            int blockHeight = pIndex->nHeight;
+
+            std::vector<const CBloomFilter*> vFilters;
+            std::vector<CBigNum> vWitnessValues;
+            for (const CGenWit& wit : vWork) {
+                vFilters.push_back(&wit.getFilter());
+                vWitnessValues.push_back(wit.getAccWitValue());
+            }
+
+            // TODO: The protocol actually doesn't care about the Accumulator..
+            libzerocoin::Accumulator accumulator(params, genWit.getDen(), genWit.getAccWitValue());
+            std::vector<int> vMintsAdded;
+            std::vector<std::list<CBigNum> > vRet;
+            int heightStop;
+
+            if (!CalculateAccumulatorWitnessesFor(
+                    params,
+                    blockHeight,
+                    COMP_MAX_AMOUNT,
+                    genWit.getDen(),
+                    vFilters,
+                    accumulator,
+                    vWitnessValues,
+                    vMintsAdded,
+                    vRet,
+                    heightStop
+            )) {
+                // TODO: Check if the calculation can fail for node's fault or it's just because the peer sent an illegal request..
+                for (; nAnswered < vWork.size(); nAnswered++)
+                    rejectWork(vWork[nAnswered], NON_DETERMINED);
+                continue;
+            }
+
+            for (; nAnswered < vWork.size(); nAnswered++) {
+                unsigned int i = nAnswered;
+                try {
+                    // A certain amount of accumulated coins are required
+                    if (vMintsAdded[i] < Params().Zerocoin_RequiredAccumulation()) {
+                        LogPrint("zero", "%s: less than %d mints added, unable to create spend\n", "wispr-light-thread", Params().Zerocoin_RequiredAccumulation());
+                        rejectWork(vWork[i], NOT_ENOUGH_MINTS);
                         continue;
                     }
 
-                    if (!res) {
-                        // TODO: Check if the GenerateAccumulatorWitnessFor can fail for node's fault or it's just because the peer sent an illegal request..
-                        rejectWork(genWit, blockHeight, NON_DETERMINED);
-                    } else {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(ret.size() * 32);
-
-                        ss << genWit.getRequestNum();
-                        ss << accumulator.getValue(); // TODO: ---> this accumulator value is not necessary. The light node should get it using the other message..
-                        ss << witness.getValue();
-                        uint32_t size = ret.size();
-                        ss << size;
-                        for (const CBigNum& bnValue : ret) {
-                            ss << bnValue;
-                        }
-                        ss << heightStop;
-                        if (genWit.getPfrom()) {
-                            LogPrintf("%s pushing message to %s \n", "wispr-light-thread", genWit.getPfrom()->addrName);
-                            genWit.getPfrom()->PushMessage("pubcoins", ss);
-                        } else{
-                            LogPrintf("%s NOT pushing message to %s \n", "wispr-light-thread", genWit.getPfrom()->addrName);
-                        }
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    ss.reserve(vRet[i].size() * 32);
+
+                    ss << vWork[i].getRequestNum();
+                    ss << accumulator.getValue(); // TODO: ---> this accumulator value is not necessary. The light node should get it using the other message..
+                    ss << vWitnessValues[i];
+                    uint32_t size = vRet[i].size();
+                    ss << size;
+                    for (const CBigNum& bnValue : vRet[i]) {
+                        ss << bnValue;
                     }
-                } else {
-                    // Rejects only the failed height
-                    rejectWork(genWit, blockHeight, NON_DETERMINED);
+                    ss << heightStop;
+                    LogPrintf("%s pushing message to %s \n", "wispr-light-thread", vWork[i].getPfrom()->addrName);
+                    vWork[i].getPfrom()->PushMessage("pubcoins", ss);
+                    finishWork(vWork[i]);
+                } catch (std::exception& e) {
+                    PrintExceptionContinue(&e, "lightzwspthread");
+                    rejectWork(vWork[i], NON_DETERMINED);
                 }
             }
         } catch (std::exception& e) {
-            //std::cout << "exception in light loop, closing it. " << e.what() << std::endl;
             PrintExceptionContinue(&e, "lightzwspthread");
-            break;
+            for (; nAnswered < vWork.size(); nAnswered++)
+                rejectWork(vWork[nAnswered], NON_DETERMINED);
         }
     }
 
 
 }
 
+void CLightWorker::finishWork(CGenWit& wit) {
+    LOCK(cs_vNodes);
+    wit.getPfrom()->Release();
+}
+
 // TODO: Think more the peer misbehaving policy..
-void CLightWorker::rejectWork(CGenWit& wit, int blockHeight, uint32_t errorNumber) {
-    if (wit.getStartingHeight() == blockHeight){
-        LogPrintf("%s rejecting work %s , error code: %s\n", "wispr-light-thread", wit.toString(), errorNumber);
+void CLightWorker::rejectWork(CGenWit& wit, uint32_t errorNumber) {
+    LogPrintf("%s rejecting work %s , error code: %s\n", "wispr-light-thread", wit.toString(), errorNumber);
+    try {
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         ss << wit.getRequestNum();
         ss << errorNumber;
         wit.getPfrom()->PushMessage("pubcoins", ss);
-    } else {
-        requestsQueue.push(wit);
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "lightzwspthread");
     }
+    finishWork(wit);
 }
@@ -7,9 +7,10 @@
 #define WISPR_LIGHTZWSPTHREAD_H
 
 #include <atomic>
+#include <list>
+#include <map>
 #include "genwit.h"
 #include "zpiv/accumulators.h"
-#include "concurrentqueue.h"
 #include "chainparams.h"
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
@@ -17,6 +18,15 @@
 extern CChain chainActive;
 // Max amount of computation for a single request
 const int COMP_MAX_AMOUNT = 60 * 24 * 60;
+/** Default for -lightzwspthreads, number of threads serving light zWSP witness requests */
+static const int DEFAULT_LIGHT_ZWSP_THREADS = 2;
+static const int MAX_LIGHT_ZWSP_THREADS = 16;
+/** Maximum number of queued witness requests, new requests are rejected past it */
+static const unsigned int MAX_LIGHT_ZWSP_QUEUE_SIZE = 500;
+/** Maximum number of queued witness requests from a single peer */
+static const int MAX_LIGHT_ZWSP_REQUESTS_PER_PEER = 10;
+/** Maximum number of requests served by one pass over the chain */
+static const unsigned int MAX_LIGHT_ZWSP_BATCH_SIZE = 32;
 
 
 /****** Thread ********/
@@ -25,14 +35,21 @@ class CLightWorker{
 
 private:
 
-    concurrentqueue<CGenWit> requestsQueue;
+    boost::mutex cs_requests;
+    boost::condition_variable condRequests;
+    std::list<CGenWit> requestsQueue;
+    //! Queued requests per peer, to cap what a single peer can hold in the queue
+    std::map<NodeId, int> mapPeerRequests;
+    //! Peer of the last served request, the next one goes to the following peer
+    NodeId nLastPeerServed;
     std::atomic<bool> isWorkerRunning;
-    boost::thread threadIns;
+    boost::thread_group threads;
 
 public:
 
     CLightWorker() {
         isWorkerRunning = false;
+        nLastPeerServed = -1;
     }
 
     enum ERROR_CODES {
@@ -40,22 +57,19 @@ public:
         NON_DETERMINED = 1
     };
 
-    bool addWitWork(const CGenWit& wit) {
-        if (!isWorkerRunning) {
-            LogPrintf("%s not running trying to add wit work \n", "wispr-light-thread");
-            return false;
-        }
-        requestsQueue.push(wit);
-        return true;
-    }
+    bool addWitWork(const CGenWit& wit);
 
     void StartLightZwspThread(boost::thread_group& threadGroup) {
-        LogPrintf("%s thread start\n", "wispr-light-thread");
-        threadIns = boost::thread(boost::bind(&CLightWorker::ThreadLightZWSPSimplified, this));
+        int nThreads = std::max(1, std::min((int)GetArg("-lightzwspthreads", DEFAULT_LIGHT_ZWSP_THREADS), MAX_LIGHT_ZWSP_THREADS));
+        LogPrintf("%s thread start, %d workers\n", "wispr-light-thread", nThreads);
+        isWorkerRunning = true;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CLightWorker::ThreadLightZWSPSimplified, this));
     }
 
     void StopLightZwspThread() {
-        threadIns.interrupt();
+        threads.interrupt_all();
+        isWorkerRunning = false;
         LogPrintf("%s thread interrupted\n", "wispr-light-thread");
     }
 
@@ -63,7 +77,13 @@ private:
 
     void ThreadLightZWSPSimplified();
 
-    void rejectWork(CGenWit& wit, int blockHeight, uint32_t errorNumber);
+    /** Wait for work and take the next peer's request, together with every queued request with the same denomination and starting height */
+    std::vector<CGenWit> popWork();
+
+    void finishWork(CGenWit& wit);
+
+    /** Answer the request with an error and release its peer, even if the message can't be sent */
+    void rejectWork(CGenWit& wit, uint32_t errorNumber);
 
 };
 
@@ -11,10 +11,13 @@
 #include "zpiv/accumulatormap.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockreader.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -61,6 +64,8 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Owns every CBlockIndex in mapBlockIndex. */
+static CBlockIndexArena blockIndexArena;
 std::map<uint256, uint256> mapProofOfStake;
 std::map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
@@ -75,7 +80,7 @@ bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 bool fClearSpendCache = false;
 
@@ -180,6 +185,20 @@ namespace
 /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
+/**
+     * Blocks downloaded ahead of their parent during headers-first sync. They are
+     * accepted once the parent is, as proof-of-stake checks need the parent's stake
+     * data. Protected by cs_main.
+     */
+    struct PendingBlock {
+        std::shared_ptr<CBlock> pblock;
+        NodeId nodeid;
+        size_t nSize;
+    };
+    std::map<uint256, PendingBlock> mapBlocksPending;
+    std::multimap<uint256, uint256> mapBlocksPendingByPrev;
+    size_t nBlocksPendingSize = 0;
+
 /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
@@ -313,6 +332,18 @@ private:
         int nBlocksInFlight;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Whether we sync from this peer with getheaders instead of getblocks.
+        bool fHeadersSync;
+        //! Hashes of the headers this peer sent, each one the child of the one before.
+        std::vector<uint256> vHeaderHashes;
+        //! Height of the first entry of vHeaderHashes.
+        int nHeaderHashesStart;
+        //! Entries of vHeaderHashes before this one are blocks we already have.
+        size_t nHeaderDownloadPos;
+        //! The last headers message was full and no getheaders is outstanding.
+        bool fMoreHeaders;
+        //! Number of getheaders sent to this peer that it hasn't answered yet.
+        int nHeadersRequested;
 
     CNodeBlocks nodeBlocks;
 
@@ -328,6 +359,11 @@ private:
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        fHeadersSync = false;
+        nHeaderHashesStart = 0;
+        nHeaderDownloadPos = 0;
+        fMoreHeaders = false;
+        nHeadersRequested = 0;
     }
 };
 
@@ -391,6 +427,23 @@ private:
         EraseOrphansFor(nodeid);
         nPreferredDownload -= state->fPreferredDownload;
 
+        // Blocks it sent ahead of their parent are fetched again from the peers that remain
+        for (auto it = mapBlocksPending.begin(); it != mapBlocksPending.end();) {
+            if (it->second.nodeid != nodeid) {
+                ++it;
+                continue;
+            }
+            auto range = mapBlocksPendingByPrev.equal_range(it->second.pblock->hashPrevBlock);
+            for (auto itPrev = range.first; itPrev != range.second; ++itPrev) {
+                if (itPrev->second == it->first) {
+                    mapBlocksPendingByPrev.erase(itPrev);
+                    break;
+                }
+            }
+            nBlocksPendingSize -= it->second.nSize;
+            it = mapBlocksPending.erase(it);
+        }
+
         mapNodeState.erase(nodeid);
     }
 
@@ -563,6 +616,80 @@ private:
     }
 }
 
+/** Whether we have the data of a block, either accepted or waiting for its parent. */
+    bool HaveBlockData(const uint256& hash)
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        return (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) || mapBlocksPending.count(hash);
+    }
+
+/** Locator for asking a peer for the headers following the last one it sent us. */
+    CBlockLocator HeadersLocator(const CNodeState* state)
+    {
+        CBlockLocator locator = chainActive.GetLocator();
+        if (!state->vHeaderHashes.empty())
+            locator.vHave.insert(locator.vHave.begin(), state->vHeaderHashes.back());
+        return locator;
+    }
+
+/** Ask a peer for headers. Only as many headers messages as were asked for are accepted from it. */
+    void PushGetHeaders(CNode* pnode, CNodeState* state, const CBlockLocator& locator)
+    {
+        pnode->PushMessage("getheaders", locator, uint256(0));
+        state->nHeadersRequested++;
+    }
+
+/** Add the blocks of a peer's header chain that are neither downloaded nor in flight to vBlocks, until
+ *  it has at most count entries. Blocks more than BLOCK_DOWNLOAD_WINDOW past the first one we still
+ *  need are not fetched, so that block processing is never too far behind the download. */
+    void FindNextHeaderBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<uint256>& vBlocks, NodeId& nodeStaller)
+    {
+        if (count == 0)
+            return;
+
+        CNodeState* state = State(nodeid);
+        assert(state != nullptr);
+
+        // Move the window past the blocks that are in
+        while (state->nHeaderDownloadPos < state->vHeaderHashes.size()) {
+            BlockMap::iterator mi = mapBlockIndex.find(state->vHeaderHashes[state->nHeaderDownloadPos]);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
+                break;
+            state->nHeaderDownloadPos++;
+        }
+        if (state->nHeaderDownloadPos >= MAX_HEADERS_RESULTS) {
+            state->vHeaderHashes.erase(state->vHeaderHashes.begin(), state->vHeaderHashes.begin() + state->nHeaderDownloadPos);
+            state->nHeaderHashesStart += state->nHeaderDownloadPos;
+            state->nHeaderDownloadPos = 0;
+        }
+
+        // Past the memory budget only the blocks that can be accepted right away are fetched
+        bool fPendingFull = nBlocksPendingSize >= MAX_BLOCKS_PENDING_SIZE;
+        size_t nWindowEnd = state->nHeaderDownloadPos + BLOCK_DOWNLOAD_WINDOW;
+        NodeId waitingfor = -1;
+        for (size_t i = state->nHeaderDownloadPos; i < state->vHeaderHashes.size(); i++) {
+            const uint256& hash = state->vHeaderHashes[i];
+            if (HaveBlockData(hash))
+                continue;
+            auto itInFlight = mapBlocksInFlight.find(hash);
+            if (itInFlight != mapBlocksInFlight.end()) {
+                if (waitingfor == -1)
+                    waitingfor = itInFlight->second.first;
+                continue;
+            }
+            if (i >= nWindowEnd) {
+                // We would be able to fetch more if the block holding up the window arrived
+                if (vBlocks.empty() && waitingfor != nodeid)
+                    nodeStaller = waitingfor;
+                return;
+            }
+            if (fPendingFull && i > state->nHeaderDownloadPos)
+                return;
+            vBlocks.push_back(hash);
+            if (vBlocks.size() == count)
+                return;
+        }
+    }
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
@@ -573,6 +700,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
         return false;
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
+    if (!state->vHeaderHashes.empty())
+        stats.nSyncHeight = std::max<int>(stats.nSyncHeight, state->nHeaderHashesStart + state->vHeaderHashes.size() - 1);
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
@@ -905,11 +1034,10 @@ int GetInputAge(CTxIn& vin)
         CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        const CCoins* coins = view.AccessCoins(vin.prevout.hash);
+        const Coin& coin = view.AccessCoin(vin.prevout);
 
-        if (coins) {
-            if (coins->nHeight < 0) return 0;
-            return (chainActive.Tip()->nHeight + 1) - coins->nHeight;
+        if (!coin.IsSpent()) {
+            return (chainActive.Tip()->nHeight + 1) - (int)coin.nHeight;
         } else
             return -1;
     }
@@ -1072,7 +1200,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 }
 
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1147,12 +1275,15 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                     return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
                 }
 
-            libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().NEW_PROTOCOLS_STARTHEIGHT()),
-                                    newSpend.getDenomination(), bnAccumulatorValue);
+                CZerocoinSpendCheck check(newSpend, Params().Zerocoin_Params(chainActive.Height() < Params().NEW_PROTOCOLS_STARTHEIGHT()),
+                                          bnAccumulatorValue, !fFakeSerialAttack, tx.GetHash());
 
                 //Check that the coin has been accumulated
-                if(!newSpend.Verify(accumulator, !fFakeSerialAttack))
-                        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                if (pvChecks) {
+                    pvChecks->push_back(CZerocoinSpendCheck());
+                    check.swap(pvChecks->back());
+                } else if (!check())
+                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
             }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1172,7 +1303,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1242,7 +1373,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack, pvChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1454,14 +1585,21 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             view.SetBackend(viewMemPool);
 
             // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                if (view.HaveCoin(COutPoint(hash, out)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
             for (const CTxIn& txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
+                    // Are inputs missing because we already have the tx?
+                    for (size_t out = 0; out < tx.vout.size(); out++) {
+                        // Optimistically just do efficient check of cache for outputs
+                        if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                            return false;
+                    }
+                    // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1683,14 +1821,21 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
             view.SetBackend(viewMemPool);
 
             // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                if (view.HaveCoin(COutPoint(hash, out)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
             for (const CTxIn& txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
+                    // Are inputs missing because we already have the tx?
+                    for (size_t out = 0; out < tx.vout.size(); out++) {
+                        // Optimistically just do efficient check of cache for outputs
+                        if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                            return false;
+                    }
+                    // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1875,10 +2020,9 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
+                const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+                if (!coin.IsSpent())
+                    nHeight = coin.nHeight;
             }
             if (nHeight > 0)
                 pindexSlow = chainActive[nHeight];
@@ -1932,14 +2076,13 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    CBlockFileRecord record;
+    if (!blockFileReader.Read(pos, "blk", 0, record))
+        return error("ReadBlockFromDisk : unable to read block at %d:%u", pos.nFile, pos.nPos);
 
     // Read block
     try {
-        filein >> block;
+        CSpanReader(record.begin(), record.end(), SER_DISK, CLIENT_VERSION) >> block;
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -2198,14 +2341,14 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
         txundo.vprevout.reserve(tx.vin.size());
         for (const CTxIn& txin : tx.vin) {
-            txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
-            assert(ret);
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 bool CScriptCheck::operator()()
@@ -2217,6 +2360,80 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+namespace
+{
+/**
+ * Valid zerocoin spend cache, to avoid verifying the proofs of a zerocoin spend
+ * twice (once when accepted into memory pool, and again when accepted into the
+ * block chain). Entries are keyed by the hash of the full spend (which commits
+ * to the accumulator checksum and the txout hash), the accumulator value and
+ * the parameters it was verified against.
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! Entries are a SHA256 of (salt, spend hash), see CSignatureCache
+    CSHA256 m_salted_hasher;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_spendcache;
+    bool fEnabled;
+
+public:
+    CZerocoinSpendCache()
+    {
+        uint256 nonce = GetRandHash();
+        m_salted_hasher.Write(nonce.begin(), 32);
+        m_salted_hasher.Write(nonce.begin(), 32);
+
+        // A block holds at most a few hundred zerocoin spends, so this
+        // comfortably covers the mempool plus several blocks
+        int64_t nMaxCacheSize = GetArg("-maxzerocoinspendcachesize", DEFAULT_MAX_ZEROCOIN_SPEND_CACHE_SIZE);
+        fEnabled = nMaxCacheSize > 0;
+        if (fEnabled)
+            setValid.setup(std::min(nMaxCacheSize, (int64_t)std::numeric_limits<int32_t>::max()));
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash)
+    {
+        CSHA256(m_salted_hasher).Write(hash.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        if (!fEnabled) return false;
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& entry)
+    {
+        if (!fEnabled) return;
+        boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+        setValid.insert(entry);
+    }
+};
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << *pspend << bnAccumulatorValue << params->accumulatorParams.accumulatorModulus << fVerifySerial;
+    // Set up on first use, once -maxzerocoinspendcachesize is parsed
+    static CZerocoinSpendCache zerocoinSpendCache;
+    uint256 entry;
+    zerocoinSpendCache.ComputeEntry(entry, ss.GetHash());
+    if (zerocoinSpendCache.Get(entry))
+        return true;
+
+    libzerocoin::Accumulator accumulator(params, pspend->getDenomination(), bnAccumulatorValue);
+    if (!pspend->Verify(accumulator, fVerifySerial)) {
+        return ::error("CZerocoinSpendCheck(): %s serial %s zerocoin spend did not verify", txHash.GetHex(), pspend->getCoinSerialNumber().GetHex());
+    }
+
+    zerocoinSpendCache.Set(entry);
+    return true;
+}
+
 CBitcoinAddress addressExp1("WfJehDzxfR7hMDdvgadn6ppZF7BLHTGmDW");
 CBitcoinAddress addressExp2("WhNMBaseKkCM2VtHN1BURZNGmGwJzQTB2Z");
 
@@ -2291,14 +2508,10 @@ CAmount GetInvalidUTXOValue()
 {
     CAmount nValue = 0;
     for (const auto& out : invalid_out::setInvalidOutPoints) {
-        bool fSpent = false;
         CCoinsViewCache cache(pcoinsTip);
-        const CCoins *coins = cache.AccessCoins(out.hash);
-        if(!coins || !coins->IsAvailable(out.n))
-            fSpent = true;
-
-        if (!fSpent)
-            nValue += coins->vout[out.n].nValue;
+        const Coin& coin = cache.AccessCoin(out);
+        if (!coin.IsSpent())
+            nValue += coin.out.nValue;
     }
 
     return nValue;
@@ -2323,20 +2536,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         CAmount nFees = 0;
         for (const auto & i : tx.vin) {
             const COutPoint& prevout = i.prevout;
-            const CCoins* coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < Params().COINBASE_MATURITY())
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
+                if (nSpendHeight - (int)coin.nHeight < Params().COINBASE_MATURITY())
                     return state.Invalid(
-                            error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - coins->nHeight, coins->IsCoinStake()),
+                            error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - (int)coin.nHeight, coin.IsCoinStake()),
                             REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs() : txin values out of range"),
                                  REJECT_INVALID, "bad-txns-inputvalues-outofrange");
         }
@@ -2367,11 +2580,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out.scriptPubKey, tx, i, flags, cacheStore);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2383,7 +2596,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
+                        CScriptCheck check(coin.out.scriptPubKey, tx, i,
                                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2404,6 +2617,60 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
+/**
+ * Find the height and coinbase/coinstake flags of a transaction, from what the chainstate upgrade kept
+ * or else from the block that contains it when the transaction index has it.
+ */
+static bool GetTxUndoMetadata(const CCoinsViewCache& view, const uint256& txid, Coin& undo)
+{
+    if (view.GetTxMetadata(txid, undo))
+        return true;
+
+    CTransaction tx;
+    uint256 hashBlock;
+    if (!GetTransaction(txid, tx, hashBlock, false))
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end())
+        return false;
+    CBlockIndex* pindex = mi->second;
+
+    undo.nHeight = pindex->nHeight;
+    undo.fCoinBase = tx.IsCoinBase();
+    undo.fCoinStake = tx.IsCoinStake();
+    return true;
+}
+
+/**
+ * Restore the UTXO in a Coin at a given COutPoint. Clears fClean if an existing output was overwritten.
+ * Returns false if the undo data lacks metadata and it can't be recovered.
+ */
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, bool& fClean)
+{
+    if (view.HaveCoin(out))
+        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height, coinbase and coinstake). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (!alternate.IsSpent()) {
+            undo.nHeight = alternate.nHeight;
+            undo.fCoinBase = alternate.fCoinBase;
+            undo.fCoinStake = alternate.fCoinStake;
+        } else {
+            // Zerocoin mints used to keep their transaction in the UTXO set, so undo records for its other
+            // outputs never carried the metadata. Mints are no longer stored, which can leave no output
+            // to take it from, so the upgrade kept it separately.
+            if (!GetTxUndoMetadata(view, out.hash, undo))
+                return false;
+        }
+    }
+    view.AddCoin(out, std::move(undo), true);
+    return true;
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
@@ -2485,55 +2752,31 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
 
         uint256 hash = tx.GetHash();
+        bool is_coinbase = tx.IsCoinBase();
+        bool is_coinstake = tx.IsCoinStake();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly. Note that transactions with only provably unspendable outputs won't
-        // have outputs available even in the block itself, so we handle that case
-        // specially with outsEmpty.
-        {
-            CCoins outsEmpty;
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
-
-            CCoins outsBlock(tx, pindex->nHeight);
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
-                fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
-
-            // remove outputs
-            outs->Clear();
+        // exactly, and remove them.
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (IsUTXOOutput(tx.vout[o])) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || (unsigned int)pindex->nHeight != coin.nHeight ||
+                    is_coinbase != (bool)coin.fCoinBase || is_coinstake != (bool)coin.fCoinStake)
+                    fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
+            }
         }
 
         // restore inputs
         if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) { // not coinbases or zerocoinspend because they dont have traditional inputs
-            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            CTxUndo& txundo = blockUndo.vtxundo[i - 1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock() : transaction and undo data inconsistent - txundo.vprevout.siz=%d tx.vin.siz=%d", txundo.vprevout.size(), tx.vin.size());
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
-                const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
-                }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out, fClean))
+                    return error("DisconnectBlock() : undo data adding output to missing transaction");
             }
         }
     }
@@ -2548,6 +2791,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        if (!zerocoinDB->EraseBlockPubcoins(pindex->GetBlockHash()))
+            return error("DisconnectBlock(): failed to erase block pubcoins");
     }
 
     if (pfClean) {
@@ -2579,6 +2825,10 @@ void static FlushBlockFile(bool fFinalize = false)
         FileCommit(fileOld);
         fclose(fileOld);
     }
+
+    // Cached read handles may still map the preallocated space that was cut off
+    if (fFinalize)
+        blockFileReader.Close(nLastBlockFile);
 }
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
@@ -2591,6 +2841,16 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(1);
+/** CheckBlock() is not always called under cs_main, so guard the single-master queue separately */
+static CCriticalSection cs_zerocoinspendcheckqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("wispr-zcspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
 void AddWrappedSerialsInflation()
 {
     CBlockIndex* pindex = chainActive[Params().Zerocoin_Block_EndFakeSerial()];
@@ -2607,7 +2867,7 @@ void AddWrappedSerialsInflation()
 
         // Add inflated denominations to block index mapSupply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->cold->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
         // Update current block index to disk
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2639,10 +2899,10 @@ void RecalculateZWSPMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        std::vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        std::vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->cold->vMintDenominationsInBlock;
+        pindex->cold->vMintDenominationsInBlock.clear();
         for (const auto& mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->cold->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
 
         if (pindex->nHeight < chainActive.Height())
             pindex = chainActive.Next(pindex);
@@ -2670,22 +2930,22 @@ void RecalculateZWSPSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->cold->zerocoinSupply = pindex->pprev->cold->zerocoinSupply;
 
         //Add mints to zWSP supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            long nDenomAdded = count(pindex->cold->vMintDenominationsInBlock.begin(), pindex->cold->vMintDenominationsInBlock.end(), denom);
+            pindex->cold->zerocoinSupply.at(denom) += nDenomAdded;
         }
 
         //Remove spends from zWSP supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->cold->zerocoinSupply.at(denom)--;
 
         // Add inflation from Wrapped Serials if block is Zerocoin_Block_EndFakeSerial()
         if (pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1)
             for (auto denom : libzerocoin::zerocoinDenomList) {
-                pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+                pindex->cold->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
             }
 
         //Rewrite money supply
@@ -2823,19 +3083,19 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 7) {
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
+            pindex->cold->zerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
         }
     }
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->cold->vMintDenominationsInBlock.clear();
     if (pindex->pprev) {
         std::set<uint256> setAddedToWallet;
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->cold->vMintDenominationsInBlock.push_back(m.GetDenomination());
+            pindex->cold->zerocoinSupply.at(denom)++;
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -2860,7 +3120,7 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->cold->zerocoinSupply.at(denom)--;
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
@@ -2870,14 +3130,14 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     }
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->cold->zerocoinSupply.at(denom));
 
     // Update Wrapped Serials amount
     // A one-time event where only the zWSP supply was off (due to serial duplication off-chain on main net)
     if (Params().NetworkID() == CBaseChainParams::MAIN && pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1
             && pindex->GetZerocoinSupply() < Params().GetSupplyBeforeFakeSerial() + GetWrapppedSerialInflationAmount()) {
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->cold->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
     }
     return true;
@@ -2942,10 +3202,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                            (pindex->nHeight == 91880 && pindex->GetBlockHash() == uint256("0x00000000000743f190a18c5577a3c2d2a1f610ae9601ac046a38084ccb7cd721")));
     if (fEnforceBIP30) {
         for (const CTransaction& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -3088,7 +3349,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (fCLTVHasMajority)
                 flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : nullptr))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fJustCheck, nScriptCheckThreads ? &vChecks : nullptr))
                 return false;
             control.Add(vChecks);
         }
@@ -3211,7 +3472,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Flush spend/mint info to disk
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
-    if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
+    std::list<libzerocoin::PublicCoin> listBlockPubcoins;
+    if (!pindex->cold->vMintDenominationsInBlock.empty() && !BlockToPubcoinList(block, listBlockPubcoins, true))
+        return state.Abort(("Failed to get block pubcoins"));
+    if (!zerocoinDB->WriteCoinMintBatch(vMints, pindex->GetBlockHash(), listBlockPubcoins)) return state.Abort(("Failed to record new mints to database"));
 
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
@@ -3262,15 +3526,20 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
-            (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
-            // Typical CCoins structures on disk are around 100 bytes in size.
+        size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0 / 9) > nCoinCacheUsage;
+        // The cache is over the limit, we have to write now.
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+        // It's been a while since we wrote the block index to disk.
+        bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000;
+        if (mode == FLUSH_STATE_ALWAYS || fCacheLarge || fCacheCritical || fPeriodicWrite) {
+            // Typical Coin structures on disk are around 48 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
@@ -3332,10 +3601,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d version=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d version=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), chainActive.Tip()->nVersion, log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -3410,9 +3679,10 @@ static int64_t nTimePostConnect = 0;
 
 /**
  * Connect a new block to chainActive. pblock is either nullptr or a pointer to a CBlock
- * corresponding to pindexNew, to bypass loading it again from disk.
+ * corresponding to pindexNew, to bypass loading it again from disk. Listeners that handle
+ * its transactions later keep it alive through the shared pointer.
  */
-bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock* pblock, bool fAlreadyChecked)
+bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, std::shared_ptr<const CBlock> pblock, bool fAlreadyChecked)
 {
     assert(pindexNew->pprev == chainActive.Tip());
     mempool.check(pcoinsTip);
@@ -3423,11 +3693,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
 
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    CBlock block;
     if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew))
+        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockNew, pindexNew))
             return state.Abort("Failed to read block");
-        pblock = &block;
+        pblock = std::move(pblockNew);
     }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
@@ -3453,11 +3723,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
 
-    // Write the chain state to disk, if necessary. Always write to disk if this is the first of a new file.
-    FlushStateMode flushMode = FLUSH_STATE_IF_NEEDED;
-    if (pindexNew->pprev && (pindexNew->GetBlockPos().nFile != pindexNew->pprev->GetBlockPos().nFile))
-        flushMode = FLUSH_STATE_ALWAYS;
-    if (!FlushStateToDisk(state, flushMode))
+    // Write the chain state to disk, if necessary.
+    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros();
     nTimeChainState += nTime5 - nTime4;
@@ -3647,10 +3914,10 @@ static void PruneBlockIndexCandidates()
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either nullptr or a pointer to a CBlock corresponding to pindexMostWork.
  */
-static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, CBlock* pblock, bool fAlreadyChecked)
+static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool fAlreadyChecked)
 {
     AssertLockHeld(cs_main);
-    if (pblock == nullptr)
+    if (!pblock)
         fAlreadyChecked = false;
     bool fInvalidFound = false;
     const CBlockIndex* pindexOldTip = chainActive.Tip();
@@ -3681,7 +3948,7 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
 
         // Connect new blocks.
         for (CBlockIndex* pindexConnect: reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : nullptr, fAlreadyChecked)) {
+            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), fAlreadyChecked)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3719,7 +3986,7 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
  * or an activated best chain. pblock is either nullptr or a pointer to a block
  * that is already loaded (to avoid loading it again from disk).
  */
-bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChecked)
+bool ActivateBestChain(CValidationState& state, const std::shared_ptr<const CBlock>& pblock, bool fAlreadyChecked)
 {
     CBlockIndex* pindexNewTip = nullptr;
     CBlockIndex* pindexMostWork = nullptr;
@@ -3740,7 +4007,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             if (pindexMostWork == nullptr || pindexMostWork == chainActive.Tip())
                 return true;
 
-            if (!ActivateBestChainStep(state, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullptr, fAlreadyChecked))
+            if (!ActivateBestChainStep(state, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : std::shared_ptr<const CBlock>(), fAlreadyChecked))
                 return false;
 
             pindexNewTip = chainActive.Tip();
@@ -3863,8 +4130,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    auto* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Create(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3893,17 +4159,17 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         if (!mapProofOfStake.count(hash))
             LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
 
-        pindexNew->hashProofOfStake = mapProofOfStake[hash];
+        pindexNew->cold->hashProofOfStake = mapProofOfStake[hash];
         uint64_t nStakeModifier = 0;
         bool fGeneratedStakeModifier = false;
         if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
             LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
         pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
         if(pindexNew->nHeight < Params().NEW_PROTOCOLS_STARTHEIGHT()){
-            pindexNew->bnStakeModifierV2 = ComputeStakeModifier(pindexNew->pprev, bn2Hash);
+            pindexNew->cold->bnStakeModifierV2 = ComputeStakeModifier(pindexNew->pprev, bn2Hash);
         }
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+        pindexNew->cold->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->cold->nStakeModifierChecksum))
             LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, std::to_string(nStakeModifier));
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -4186,15 +4452,23 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     std::vector<CBigNum> vBlockSerials;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     int blockHeight = chainActive.Height() + 1;
+    // Zerocoin spend proofs are verified on the -par worker threads; fall back to
+    // inline verification if another thread is already using the queue
+    TRY_LOCK(cs_zerocoinspendcheckqueue, lockSpendCheckQueue);
+    bool fParallelSpendChecks = nScriptCheckThreads && lockSpendCheckQueue;
+    CCheckQueueControl<CZerocoinSpendCheck> control(fParallelSpendChecks ? &zerocoinspendcheckqueue : nullptr);
     for (const CTransaction& tx : block.vtx) {
+        std::vector<CZerocoinSpendCheck> vChecks;
         if (!CheckTransaction(
                 tx,
                 fZerocoinActive,
                 blockHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT(),
                 state,
-                isBlockBetweenFakeSerialAttackRange(blockHeight)
+                isBlockBetweenFakeSerialAttackRange(blockHeight),
+                fParallelSpendChecks ? &vChecks : nullptr
         ))
             return error("CheckBlock() : CheckTransaction failed");
+        control.Add(vChecks);
 
         // double check that there are no double spent zWSP spends in this block
         if (tx.HasZerocoinSpendInputs()) {
@@ -4221,6 +4495,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    if (!control.Wait())
+        return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"),
+                         REJECT_INVALID, "bad-zerocoinspend");
+
 
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx) {
@@ -4387,6 +4665,37 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
+/**
+ * Checks of a header received during headers-first sync that don't need its parent in the
+ * block index. The block itself goes through all of the checks once it is downloaded.
+ */
+static bool CheckHeaderForSync(const CBlockHeader& header, int nHeight, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = header.GetHash();
+
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_FAILED_MASK))
+        return state.DoS(20, error("%s : block %s is marked invalid", __func__, hash.ToString()), REJECT_INVALID, "duplicate");
+
+    if (Params().NetworkID() != CBaseChainParams::REGTEST) {
+        // Same version rule as CheckBlockHeader, at the height of the header instead of the tip
+        bool fZerocoinHeight = nHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT();
+        if ((header.nVersion >= Params().Zerocoin_HeaderVersion()) != fZerocoinHeight)
+            return state.DoS(50, error("%s : block version %d not allowed at height %d", __func__, header.nVersion, nHeight),
+                             REJECT_INVALID, "block-version");
+        if (header.GetBlockTime() > GetAdjustedTime() + 7200)
+            return state.Invalid(error("%s : block timestamp too far in the future", __func__),
+                                 REJECT_INVALID, "time-too-new");
+    }
+
+    if (!Checkpoints::CheckBlock(nHeight, hash))
+        return state.DoS(100, error("%s : rejected by checkpoint lock-in at %d", __func__, nHeight),
+                         REJECT_CHECKPOINT, "checkpoint mismatch");
+
+    return true;
+}
+
 bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
@@ -4709,17 +5018,11 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         const CCoinsViewCache coins(pcoinsTip);
         if(!stakeTxIn.HasZerocoinSpendInputs()) {
             for (const CTxIn& in: stakeTxIn.vin) {
-                const CCoins* coin = coins.AccessCoins(in.prevout.hash);
+                const Coin& coin = coins.AccessCoin(in.prevout);
 
-                if(!coin && !isBlockFromFork){
-                    // No coins on the main chain
-                    return error("%s: coin stake inputs not available on main chain, received height %d vs current %d", __func__, nHeight, chainActive.Height());
-                }
-                if(coin && !coin->IsAvailable(in.prevout.n)){
-                    if(!isBlockFromFork){
-                        // Coins not available
-                        return error("%s: coin stake inputs already spent in main chain", __func__);
-                    }
+                if(coin.IsSpent() && !isBlockFromFork){
+                    // No coins on the main chain, or already spent there
+                    return error("%s: coin stake inputs not available or already spent on main chain, received height %d vs current %d", __func__, nHeight, chainActive.Height());
                 }
             }
         } else {
@@ -4816,7 +5119,57 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
+/** Accept the downloaded blocks that were waiting for hashParent, and in turn their own children. */
+void static ProcessPendingBlocks(const uint256& hashParent)
+{
+    // The children accepted below come back here from ProcessNewBlock; the loop already takes care of theirs
+    static thread_local bool fProcessing = false;
+    if (fProcessing)
+        return;
+    fProcessing = true;
+
+    std::vector<uint256> vWork(1, hashParent);
+    while (!vWork.empty()) {
+        uint256 hash = vWork.back();
+        vWork.pop_back();
+
+        bool fParentAccepted;
+        std::vector<PendingBlock> vChildren;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            fParentAccepted = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA) && !(mi->second->nStatus & BLOCK_FAILED_MASK);
+            auto range = mapBlocksPendingByPrev.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                auto itPending = mapBlocksPending.find(it->second);
+                if (itPending == mapBlocksPending.end())
+                    continue;
+                nBlocksPendingSize -= itPending->second.nSize;
+                vChildren.push_back(std::move(itPending->second));
+                mapBlocksPending.erase(itPending);
+            }
+            mapBlocksPendingByPrev.erase(range.first, range.second);
+        }
+
+        for (PendingBlock& pending : vChildren) {
+            // Children of a block that didn't make it are dropped together with their own children
+            vWork.push_back(pending.pblock->GetHash());
+            if (!fParentAccepted)
+                continue;
+            LimitValidationInterfaceQueue();
+            CValidationState state;
+            ProcessNewBlock(state, nullptr, pending.pblock);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(pending.nodeid, nDoS);
+            }
+        }
+    }
+    fProcessing = false;
+}
+
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const std::shared_ptr<CBlock>& pblock, CDiskBlockPos* dbp)
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
@@ -4913,6 +5266,9 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     LogPrintf("%s : ACCEPTED Block %ld in %ld milliseconds with size=%d\n", __func__, GetHeight(), GetTimeMillis() - nStartTime,
               pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION));
 
+    // Blocks downloaded ahead of this one can be accepted now, wherever it came from
+    ProcessPendingBlocks(pblock->GetHash());
+
     return true;
 }
 
@@ -5016,9 +5372,7 @@ CBlockIndex* InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    auto* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Create();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -5033,16 +5387,21 @@ bool static LoadBlockIndexDB(std::string& strError)
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*> & item: vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
+    // Calculate nChainWork. A parent is always lower than its children, so
+    // visiting entries bucketed by height (a counting sort, linear in the size
+    // of the index) sees every pprev before the blocks built on it.
+    int nMaxHeight = 0;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    std::vector<size_t> vHeightOffset(nMaxHeight + 2, 0);
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vHeightOffset[item.second->nHeight + 1]++;
+    for (int nHeight = 0; nHeight <= nMaxHeight; nHeight++)
+        vHeightOffset[nHeight + 1] += vHeightOffset[nHeight];
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vSortedByHeight[vHeightOffset[item.second->nHeight]++] = item.second;
+    for (CBlockIndex* pindex : vSortedByHeight) {
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
@@ -5182,7 +5541,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -5237,15 +5596,16 @@ void UnloadBlockIndex()
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
     nQueuedValidatedHeaders = 0;
+    mapBlocksPending.clear();
+    mapBlocksPendingByPrev.clear();
+    nBlocksPendingSize = 0;
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -5284,7 +5644,7 @@ bool InitBlockIndex()
             CBlockIndex* pindex = AddToBlockIndex(block);
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
                 return error("LoadBlockIndex() : genesis block not accepted");
-            if (!ActivateBestChain(state, &block))
+            if (!ActivateBestChain(state, std::make_shared<const CBlock>(block)))
                 return error("LoadBlockIndex() : genesis block cannot be activated");
             // Force a chainstate write so that when we VerifyDB in a moment, it doesnt check stale data
             return FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
@@ -5338,7 +5698,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     dbp->nPos = nBlockPos;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                CBlock block;
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                CBlock& block = *pblock;
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
@@ -5355,7 +5716,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
                     CValidationState state;
-                    if (ProcessNewBlock(state, nullptr, &block, dbp))
+                    LimitValidationInterfaceQueue();
+                    if (ProcessNewBlock(state, nullptr, pblock, dbp))
                         nLoaded++;
                     if (state.IsError())
                         break;
@@ -5372,13 +5734,14 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
                         auto it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                        if (ReadBlockFromDisk(*pblockrecursive, it->second)) {
+                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
                                       head.ToString());
                             CValidationState dummy;
-                            if (ProcessNewBlock(dummy, nullptr, &block, &it->second)) {
+                            if (ProcessNewBlock(dummy, nullptr, pblockrecursive, &it->second)) {
                                 nLoaded++;
-                                queue.push_back(block.GetHash());
+                                queue.push_back(pblockrecursive->GetHash());
                             }
                         }
                         range.first++;
@@ -5605,7 +5968,8 @@ bool static AlreadyHave(const CInv& inv)
             bool txInMap = false;
             txInMap = mempool.exists(inv.hash);
             return txInMap || mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoins(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
         case MSG_DSTX:
             return mapObfuscationBroadcastTxes.count(inv.hash);
@@ -6217,7 +6581,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks" || (strCommand == "getheaders" && pfrom->nVersion < HEADERS_FIRST_VERSION)) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -6249,16 +6613,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
         LOCK(cs_main);
 
-        if (IsInitialBlockDownload())
-            return true;
-
         CBlockIndex* pindex = nullptr;
         if (locator.IsNull()) {
             // If locator is null, return the hashStop block
@@ -6443,7 +6804,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == "headers" && pfrom->nVersion >= HEADERS_FIRST_VERSION && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -6461,57 +6822,114 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         }
 
         LOCK(cs_main);
+        CNodeState* state = State(pfrom->GetId());
+
+        if (state->nHeadersRequested == 0) {
+            LogPrint("net", "unrequested headers from peer=%d\n", pfrom->id);
+            return true;
+        }
+        state->nHeadersRequested--;
 
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
-        CBlockIndex* pindexLast = nullptr;
-        for (const CBlockHeader& header: headers) {
-            CValidationState state;
-            if (pindexLast != nullptr && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+
+        // Headers are not added to the block index: the stake data of a block index entry
+        // needs the whole block. They only tell which blocks to fetch, and from whom.
+        std::vector<uint256>& vHashes = state->vHeaderHashes;
+        const uint256& hashFirstPrev = headers[0].hashPrevBlock;
+        BlockMap::iterator mi = mapBlockIndex.find(hashFirstPrev);
+        if (!vHashes.empty() && vHashes.back() == hashFirstPrev) {
+            // Continues the headers we have from this peer
+        } else if (mi != mapBlockIndex.end()) {
+            vHashes.clear();
+            state->nHeaderHashesStart = mi->second->nHeight + 1;
+            state->nHeaderDownloadPos = 0;
+        } else {
+            auto it = std::find(vHashes.begin(), vHashes.end(), hashFirstPrev);
+            if (it == vHashes.end()) {
+                LogPrint("net", "unconnecting headers from peer=%d\n", pfrom->id);
+                return true;
+            }
+            // The peer switched to a fork of the headers it sent before
+            vHashes.erase(it + 1, vHashes.end());
+            state->nHeaderDownloadPos = std::min(state->nHeaderDownloadPos, vHashes.size());
+        }
+        if (vHashes.size() - state->nHeaderDownloadPos + nCount > MAX_HEADERS_AHEAD) {
+            // More are asked for once the download catches up
+            LogPrint("net", "too many headers ahead of the download from peer=%d\n", pfrom->id);
+            state->fMoreHeaders = true;
+            return true;
+        }
+
+        int nHeight = state->nHeaderHashesStart + vHashes.size();
+        for (unsigned int n = 0; n < nCount; n++, nHeight++) {
+            const CBlockHeader& header = headers[n];
+            uint256 hash = header.GetHash();
+            if (n > 0 && header.hashPrevBlock != headers[n - 1].GetHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            CValidationState stateHeader;
+            if (!CheckHeaderForSync(header, nHeight, stateHeader)) {
                 int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
-                    return error(strError.c_str());
-                }
+                if (stateHeader.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header received %s", hash.ToString());
             }
+            vHashes.push_back(hash);
         }
 
-        if (pindexLast)
-            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        UpdateBlockAvailability(pfrom->GetId(), vHashes.back());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
-            // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256(0));
-        }
-
-        CheckBlockIndex();
+        // Headers message had its maximum size; the peer may have more headers. They are asked
+        // for once the download gets close to the end of the ones we have.
+        state->fMoreHeaders = (nCount == MAX_HEADERS_RESULTS);
+        LogPrint("net", "received headers up to %d from peer=%d (startheight:%d)\n", nHeight - 1, pfrom->id, pfrom->nStartingHeight);
     }
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
-        CBlock block;
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        CBlock& block = *pblock;
         vRecv >> block;
         uint256 hashBlock = block.GetHash();
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
-        //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
+        bool fParentKnown = true;
         if (!mapBlockIndex.count(block.hashPrevBlock)) {
+            LOCK(cs_main);
+            CNodeState* state = State(pfrom->GetId());
+            fParentKnown = mapBlockIndex.count(block.hashPrevBlock);
+            auto itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (!fParentKnown && itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId()) {
+                // Fetched ahead of its parent during headers-first sync, accepted once the parent is
+                MarkBlockAsReceived(hashBlock);
+                pfrom->AddInventoryKnown(inv);
+                if (!mapBlocksPending.count(hashBlock)) {
+                    size_t nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+                    mapBlocksPendingByPrev.insert(std::make_pair(block.hashPrevBlock, hashBlock));
+                    PendingBlock& pending = mapBlocksPending[hashBlock];
+                    pending.pblock = pblock;
+                    pending.nodeid = pfrom->GetId();
+                    pending.nSize = nSize;
+                    nBlocksPendingSize += nSize;
+                }
+                return true;
+            }
+            if (!fParentKnown && state->fHeadersSync) {
+                // Announced past the headers we have from this peer, ask for the ones in between
+                if (state->nHeadersRequested == 0)
+                    PushGetHeaders(pfrom, state, HeadersLocator(state));
+                return true;
+            }
+        }
+
+        //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
+        if (!fParentKnown) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
@@ -6526,7 +6944,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
             CValidationState state;
             if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
+                // Don't let the listeners fall further behind
+                LimitValidationInterfaceQueue();
+                ProcessNewBlock(state, pfrom, pblock);
                 int nDoS;
                 if(state.IsInvalid(nDoS)) {
                     pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
@@ -6541,6 +6961,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             } else {
                 LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
+            ProcessPendingBlocks(hashBlock);
         }
     }
 
@@ -7060,17 +7481,28 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             pindexBestHeader = chainActive.Tip();
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && fFetch /*&& !fImporting*/ && !fReindex) {
-            // Only actively request headers from a single peer, unless we're close to end of initial download.
-            if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
+            if (Params().HeadersFirstSyncingActive() && pto->nVersion >= HEADERS_FIRST_VERSION) {
+                // Headers are cheap, so they come from every peer; that lets blocks come from all of them too.
+                state.fSyncStarted = true;
+                state.fHeadersSync = true;
+                nSyncStarted++;
+                LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", chainActive.Height(), pto->id, pto->nStartingHeight);
+                PushGetHeaders(pto, &state, chainActive.GetLocator(chainActive.Tip()));
+            } else if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
+                // Only actively request blocks from a single peer, unless we're close to end of initial download.
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
                 pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
             }
         }
 
+        // Keep the headers of a peer ahead of the blocks downloaded from it
+        if (state.fMoreHeaders && state.vHeaderHashes.size() - state.nHeaderDownloadPos < BLOCK_DOWNLOAD_WINDOW + MAX_HEADERS_RESULTS) {
+            state.fMoreHeaders = false;
+            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", state.nHeaderHashesStart + state.vHeaderHashes.size() - 1, pto->id, pto->nStartingHeight);
+            PushGetHeaders(pto, &state, HeadersLocator(&state));
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -7155,6 +7587,14 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 LogPrintf("Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                           pindex->nHeight, pto->id);
             }
+            // Blocks from the headers of this peer, out of order within the download window
+            std::vector<uint256> vToDownloadHashes;
+            FindNextHeaderBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownloadHashes, staller);
+            for (const uint256& hash : vToDownloadHashes) {
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                MarkBlockAsInFlight(pto->GetId(), hash);
+                LogPrint("net", "Requesting block %s peer=%d\n", hash.ToString(), pto->id);
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
@@ -7215,24 +7655,28 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+    // The checksum follows the undo data
+    CBlockFileRecord record;
+    if (!blockFileReader.Read(pos, "rev", sizeof(uint256), record))
+        return error("CBlockUndo::ReadFromDisk : unable to read undo data");
 
     // Read block
     uint256 hashChecksum;
+    size_t nSize;
     try {
+        CSpanReader filein(record.begin(), record.end(), SER_DISK, CLIENT_VERSION);
         filein >> *this;
+        nSize = record.size() - filein.size();
         filein >> hashChecksum;
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
-    // Verify checksum
+    // Verify checksum over the bytes as stored. Records from older versions carry the transaction version
+    // where 0 is written now, so hashing a re-serialization would reject them.
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
-    hasher << *this;
+    hasher.write(record.begin(), nSize);
     if (hashChecksum != hasher.GetHash())
         return error("CBlockUndo::ReadFromDisk : Checksum mismatch");
 
@@ -7252,10 +7696,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -533,11 +533,59 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    {
+        LOCK(cs_mapMasternodeBlocks);
+        if (mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1) >= MNPAYMENTS_PAID_VOTES)
+            mapPayeePaidHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::AddPaidHeights(const CMasternodeBlockPayees& blockPayees)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& payee : blockPayees.vecPayments) {
+        if (payee.nVotes >= MNPAYMENTS_PAID_VOTES)
+            mapPayeePaidHeights[payee.scriptPubKey].insert(blockPayees.nBlockHeight);
+    }
+}
+
+void CMasternodePayments::EraseBlockPayees(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    auto it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it == mapMasternodeBlocks.end())
+        return;
+
+    LOCK(cs_vecPayments);
+    for (const CMasternodePayee& payee : it->second.vecPayments) {
+        auto itPaid = mapPayeePaidHeights.find(payee.scriptPubKey);
+        if (itPaid == mapPayeePaidHeights.end())
+            continue;
+        itPaid->second.erase(nBlockHeight);
+        if (itPaid->second.empty())
+            mapPayeePaidHeights.erase(itPaid);
+    }
+    mapMasternodeBlocks.erase(it);
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    auto it = mapPayeePaidHeights.find(payee);
+    if (it == mapPayeePaidHeights.end())
+        return 0;
+
+    auto itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin())
+        return 0;
+    --itHeight;
+    return *itHeight >= nMinHeight ? *itHeight : 0;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -665,7 +713,7 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            EraseBlockPayees(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -6,6 +6,7 @@
 #ifndef MASTERNODE_PAYMENTS_H
 #define MASTERNODE_PAYMENTS_H
 
+#include <set>
 #include <utility>
 #include "key.h"
 #include "main.h"
@@ -24,6 +25,8 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// votes a winner needs for the masternode to count as paid at that height
+#define MNPAYMENTS_PAID_VOTES 2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -103,19 +106,21 @@ public:
         vecPayments.clear();
     }
 
-    void AddPayee(const CScript& payeeIn, int nIncrement)
+    /// Add votes for a payee and return its total
+    int AddPayee(const CScript& payeeIn, int nIncrement)
     {
         LOCK(cs_vecPayments);
 
         for (CMasternodePayee& payee : vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
                 payee.nVotes += nIncrement;
-                return;
+                return payee.nVotes;
             }
         }
 
         CMasternodePayee c(payeeIn, nIncrement);
         vecPayments.push_back(c);
+        return nIncrement;
     }
 
     bool GetPayee(CScript& payee)
@@ -235,6 +240,12 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // heights of mapMasternodeBlocks where each payee has at least MNPAYMENTS_PAID_VOTES votes
+    std::map<CScript, std::set<int> > mapPayeePaidHeights;
+
+    void AddPaidHeights(const CMasternodeBlockPayees& blockPayees);
+    void EraseBlockPayees(int nBlockHeight);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -251,6 +262,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeePaidHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -259,6 +271,8 @@ public:
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
+    /// Newest height in [nMinHeight, nMaxHeight] where the payee won with enough votes, 0 if there is none
+    int GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
@@ -294,6 +308,13 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+
+        if (ser_action.ForRead()) {
+            LOCK(cs_mapMasternodeBlocks);
+            mapPayeePaidHeights.clear();
+            for (const auto& it : mapMasternodeBlocks)
+                AddPaidHeights(it.second);
+        }
     }
 };
 
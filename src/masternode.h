@@ -26,8 +26,9 @@
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
-extern std::map<int64_t, uint256> mapCacheBlockHashes;
 
+/** Hash of the active chain block at height nBlockHeight - 1, i.e. the block before the requested height. A height of 0
+ * stands for the tip, giving the block before it, and a negative one gives the tip. False past the tip or genesis. */
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
 
@@ -217,7 +218,7 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nMnCount = -1);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -280,7 +281,8 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    /// Time of the last payment found within 1.25 * nMnCount blocks, nMnCount defaults to the enabled masternodes
+    int64_t GetLastPaid(int nMnCount = -1);
     bool IsValidNetAddr();
 };
 
@@ -25,22 +25,6 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const std::pair<int64_t, CTxIn>& t1,
-        const std::pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const std::pair<int64_t, CMasternode>& t1,
-        const std::pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 //
 // CMasternodeDB
 //
@@ -208,6 +192,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == nullptr) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        IndexMasternode(vMasternodes.size() - 1);
+        mapScoreOrders.clear();
         return true;
     }
 
@@ -230,10 +216,49 @@ void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
     mWeAskedForMasternodeListEntry[vin.prevout] = askAgain;
 }
 
+void CMasternodeMan::CheckCollaterals()
+{
+    AssertLockHeld(cs);
+
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) return;
+    LOCK(mempool.cs);
+
+    int nHeight = chainActive.Height();
+    for (CMasternode& mn : vMasternodes) {
+        if (mn.unitTest || mn.activeState == CMasternode::MASTERNODE_VIN_SPENT) continue;
+
+        const COutPoint& outpoint = mn.vin.prevout;
+        if (pcoinsTip->AccessCoin(outpoint).IsSpent() || mempool.mapNextTx.count(outpoint) || !ValidOutPoint(outpoint, nHeight)) {
+            LogPrint("masternode", "CMasternodeMan::CheckCollaterals - collateral %s spent\n", outpoint.ToString());
+            mn.activeState = CMasternode::MASTERNODE_VIN_SPENT;
+        }
+    }
+}
+
+void CMasternodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs()) return;
+
+    LOCK(cs);
+
+    for (const CTxIn& txin : tx.vin) {
+        auto it = mapMasternodesByOutpoint.find(txin.prevout);
+        if (it == mapMasternodesByOutpoint.end()) continue;
+
+        CMasternode& mn = vMasternodes[it->second];
+        if (mn.unitTest || mn.activeState == CMasternode::MASTERNODE_VIN_SPENT) continue;
+
+        LogPrint("masternode", "CMasternodeMan::SyncTransaction - collateral %s spent by %s\n", txin.prevout.ToString(), tx.GetHash().ToString());
+        mn.activeState = CMasternode::MASTERNODE_VIN_SPENT;
+    }
+}
+
 void CMasternodeMan::Check()
 {
     LOCK(cs);
 
+    CheckCollaterals();
     for (CMasternode& mn : vMasternodes) {
         mn.Check();
     }
@@ -246,6 +271,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    bool fRemoved = false;
     auto it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
@@ -278,10 +304,13 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            fRemoved = true;
         } else {
             ++it;
         }
     }
+    if (fRemoved)
+        RebuildIndexes();
 
     // check who's asked for the Masternode list
     auto it1 = mAskedUsForMasternodeList.begin();
@@ -339,6 +368,10 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapMasternodesByOutpoint.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+    mapScoreOrders.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -434,28 +467,76 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
-CMasternode* CMasternodeMan::Find(const CScript& payee)
+void CMasternodeMan::IndexMasternode(size_t nPos)
 {
     LOCK(cs);
-    CScript payee2;
+    const CMasternode& mn = vMasternodes[nPos];
+    mapMasternodesByOutpoint.emplace(mn.vin.prevout, nPos);
+    mapMasternodesByPubKey.emplace(mn.pubKeyMasternode, nPos);
+    mapMasternodesByPayee.emplace(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()), nPos);
+}
 
-    for (CMasternode& mn : vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+template <typename Key>
+static void EraseFromIndex(std::multimap<Key, size_t>& mapIndex, const Key& key, size_t nPos)
+{
+    auto range = mapIndex.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == nPos) {
+            mapIndex.erase(it);
+            return;
+        }
     }
-    return nullptr;
+}
+
+void CMasternodeMan::UnindexMasternode(size_t nPos)
+{
+    LOCK(cs);
+    const CMasternode& mn = vMasternodes[nPos];
+    mapMasternodesByOutpoint.erase(mn.vin.prevout);
+    EraseFromIndex(mapMasternodesByPubKey, mn.pubKeyMasternode, nPos);
+    EraseFromIndex(mapMasternodesByPayee, GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()), nPos);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    LOCK(cs);
+    mapMasternodesByOutpoint.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+    mapScoreOrders.clear();
+    for (size_t nPos = 0; nPos < vMasternodes.size(); nPos++)
+        IndexMasternode(nPos);
+}
+
+// Several masternodes can share a key or payee, return the first one in the list like a scan would
+template <typename Key>
+static size_t FindInIndex(const std::multimap<Key, size_t>& mapIndex, const Key& key)
+{
+    size_t nFound = std::numeric_limits<size_t>::max();
+    auto range = mapIndex.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+        nFound = std::min(nFound, it->second);
+    return nFound;
+}
+
+CMasternode* CMasternodeMan::Find(const CScript& payee)
+{
+    LOCK(cs);
+
+    size_t nPos = FindInIndex(mapMasternodesByPayee, payee);
+    if (nPos == std::numeric_limits<size_t>::max())
+        return nullptr;
+    return &vMasternodes[nPos];
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return nullptr;
+    auto it = mapMasternodesByOutpoint.find(vin.prevout);
+    if (it == mapMasternodesByOutpoint.end())
+        return nullptr;
+    return &vMasternodes[it->second];
 }
 
 
@@ -463,11 +544,10 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return nullptr;
+    size_t nPos = FindInIndex(mapMasternodesByPubKey, pubKeyMasternode);
+    if (nPos == std::numeric_limits<size_t>::max())
+        return nullptr;
+    return &vMasternodes[nPos];
 }
 
 //
@@ -501,7 +581,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -590,9 +670,38 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
+const std::vector<size_t>& CMasternodeMan::GetScoreOrder(int64_t nBlockHeight, const uint256& hashBlock)
+{
+    AssertLockHeld(cs);
+
+    auto it = mapScoreOrders.find(nBlockHeight);
+    if (it != mapScoreOrders.end() && it->second.first == hashBlock)
+        return it->second.second;
+
+    std::vector<std::pair<uint256, size_t> > vecScores;
+    vecScores.reserve(vMasternodes.size());
+    for (size_t nPos = 0; nPos < vMasternodes.size(); nPos++)
+        vecScores.emplace_back(vMasternodes[nPos].CalculateScore(1, nBlockHeight), nPos);
+
+    // Highest score first, ties keep the list order
+    std::sort(vecScores.begin(), vecScores.end(), [](const std::pair<uint256, size_t>& a, const std::pair<uint256, size_t>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+
+    if (it == mapScoreOrders.end() && mapScoreOrders.size() >= MASTERNODES_SCORES_CACHE_SIZE)
+        mapScoreOrders.erase(mapScoreOrders.begin());
+
+    std::pair<uint256, std::vector<size_t> >& entry = mapScoreOrders[nBlockHeight];
+    entry.first = hashBlock;
+    entry.second.clear();
+    entry.second.reserve(vecScores.size());
+    for (const std::pair<uint256, size_t>& score : vecScores)
+        entry.second.push_back(score.second);
+    return entry.second;
+}
+
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -600,8 +709,12 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
+    LOCK(cs);
+
     // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    int rank = 0;
+    for (size_t nPos : GetScoreOrder(nBlockHeight, hash)) {
+        CMasternode& mn = vMasternodes[nPos];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -618,18 +731,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s: vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -639,36 +743,34 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<std::pair<int64_t, CMasternode> > vecMasternodeScores;
     std::vector<std::pair<int, CMasternode> > vecMasternodeRanks;
 
     //make sure we know about this block
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    LOCK(cs);
+
+    // enabled masternodes by score, then the others
+    std::vector<size_t> vecInactive;
+    int rank = 0;
+    for (size_t nPos : GetScoreOrder(nBlockHeight, hash)) {
+        CMasternode& mn = vMasternodes[nPos];
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(std::make_pair(9999, mn));
+            vecInactive.push_back(nPos);
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn));
+        rank++;
+        vecMasternodeRanks.push_back(std::make_pair(rank, mn));
     }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    for (std::pair<int64_t, CMasternode> & s: vecMasternodeScores) {
+    for (size_t nPos : vecInactive) {
         rank++;
-        vecMasternodeRanks.push_back(std::make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(std::make_pair(rank, vMasternodes[nPos]));
     }
 
     return vecMasternodeRanks;
@@ -676,29 +778,25 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    //make sure we know about this block
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return nullptr;
+
+    LOCK(cs);
 
     // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    int rank = 0;
+    for (size_t nPos : GetScoreOrder(nBlockHeight, hash)) {
+        CMasternode& mn = vMasternodes[nPos];
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s: vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -940,7 +1038,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                 if (pmn->nLastDsee < sigTime) { //take the newest entry
                     LogPrint("masternode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
                     if (pmn->protocolVersion < GETHEADERS_VERSION) {
+                        LOCK(cs);
+                        UnindexMasternode(pmn - &vMasternodes[0]);
                         pmn->pubKeyMasternode = pubkey2;
+                        IndexMasternode(pmn - &vMasternodes[0]);
                         pmn->sigTime = sigTime;
                         pmn->sig = vchSig;
                         pmn->protocolVersion = protocolVersion;
@@ -1139,6 +1240,7 @@ void CMasternodeMan::Remove(const CTxIn& vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            RebuildIndexes();
             break;
         }
         ++it;
@@ -1158,10 +1260,21 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
         CMasternode mn(mnb);
         Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        UpdateFromNewBroadcast(*pmn, mnb);
     }
 }
 
+bool CMasternodeMan::UpdateFromNewBroadcast(CMasternode& mn, CMasternodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    size_t nPos = &mn - &vMasternodes[0];
+    UnindexMasternode(nPos);
+    bool fUpdated = mn.UpdateFromNewBroadcast(mnb);
+    IndexMasternode(nPos);
+    return fUpdated;
+}
+
 std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
@@ -13,9 +13,11 @@
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SCORES_CACHE_SIZE 32
 
 
 class CMasternodeMan;
@@ -47,7 +49,7 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
-class CMasternodeMan
+class CMasternodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -58,6 +60,12 @@ private:
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // positions in vMasternodes by collateral outpoint, masternode key and payee script
+    std::map<COutPoint, size_t> mapMasternodesByOutpoint;
+    std::multimap<CPubKey, size_t> mapMasternodesByPubKey;
+    std::multimap<CScript, size_t> mapMasternodesByPayee;
+    // positions in vMasternodes from the highest score down, with the hash of the block they were scored for, by height
+    std::map<int64_t, std::pair<uint256, std::vector<size_t> > > mapScoreOrders;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -65,6 +73,20 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    /// Add or drop the entry at nPos in the indexes, around any change of its keys
+    void IndexMasternode(size_t nPos);
+    void UnindexMasternode(size_t nPos);
+    /// Recompute the indexes, after entries were erased from vMasternodes
+    void RebuildIndexes();
+    /// Every masternode ordered by score for the block at nBlockHeight, computed once per height and list
+    const std::vector<size_t>& GetScoreOrder(int64_t nBlockHeight, const uint256& hashBlock);
+    /// Mark every masternode whose collateral is spent in the chain or the mempool, in one pass over the coins view
+    void CheckCollaterals();
+
+protected:
+    /// Mark the masternodes whose collateral the transaction spends
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -88,6 +110,9 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+
+        if (ser_action.ForRead())
+            RebuildIndexes();
     }
 
     CMasternodeMan();
@@ -156,6 +181,9 @@ public:
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
+
+    /// Update an entry from a newer broadcast, keeping the indexes in step with its keys
+    bool UpdateFromNewBroadcast(CMasternode& mn, CMasternodeBroadcast& mnb);
 };
 
 #endif
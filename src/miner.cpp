@@ -41,25 +41,45 @@
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool. Past the high-priority area, the block
+// is filled with packages: a transaction together with its ancestors that
+// are not in the block yet, by the fee rate of the whole package. Once some
+// ancestors of a transaction are in the block, its package totals are
+// tracked here, less the ancestors already included.
 //
-class COrphan
+class CModifiedPackage
 {
 public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
+    const CTxMemPoolEntry* entry;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpsWithAncestors;
+
+    CModifiedPackage(const CTxMemPoolEntry* entryIn) : entry(entryIn),
+                                                       nSizeWithAncestors(entryIn->GetSizeWithAncestors()),
+                                                       nModFeesWithAncestors(entryIn->GetModFeesWithAncestors()),
+                                                       nSigOpsWithAncestors(entryIn->GetSigOpsWithAncestors())
+    {
+    }
+};
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+// Same order as CTxMemPool::setAncestorScore, highest package fee rate first
+class CompareModifiedPackage
+{
+public:
+    bool operator()(const CModifiedPackage& a, const CModifiedPackage& b) const
     {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2)
+            return a.entry->GetTx().GetHash() < b.entry->GetTx().GetHash();
+        return f1 > f2;
     }
 };
 
+// Packages that may fail to fit before giving up on a nearly full block
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
@@ -103,6 +123,119 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
     }
 }
 
+static bool IsTxEligibleForBlock(const CTransaction& tx, int nHeight)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+        return false;
+    if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+        return false;
+    return true;
+}
+
+static double GetZerocoinSpendPriority(const CTransaction& tx, unsigned int nTxSize)
+{
+    //Give a high priority to zerocoinspends to get into the next block
+    //Priority = (age^6+100000)*amount - gives higher priority to zwsps that have been in mempool long
+    //and higher priority to zwsps that are large in value
+    const uint256& txid = tx.GetHash();
+    int64_t nTimeSeen = GetAdjustedTime();
+    double nConfs = 100000;
+
+    auto it = mapZerocoinspends.find(txid);
+    if (it != mapZerocoinspends.end()) {
+        nTimeSeen = it->second;
+    } else {
+        //for some reason not in map, add it
+        mapZerocoinspends[txid] = nTimeSeen;
+    }
+
+    double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
+    CAmount nTotalIn = tx.GetZerocoinSpent();
+
+    // zWSP spends can have very large priority, use non-overflowing safe functions
+    double dPriority = 0;
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
+        dPriority = double_safe_multiplication(dPriority, nTotalIn);
+    }
+
+    return tx.ComputePriority(dPriority, nTxSize);
+}
+
+// Check that tx is valid on top of view and uses less than nSigOpsLeft sigops, then apply it to view
+// and add its zerocoin serials to vSerials, the serials spent so far
+static bool TestTxForBlock(const CTransaction& tx, int nHeight, CCoinsViewCache& view, std::vector<CBigNum>& vSerials, unsigned int nSigOpsLeft, CAmount& nTxFees, unsigned int& nTxSigOps)
+{
+    if (!view.HaveInputs(tx))
+        return false;
+
+    // double check that there are no double spent zWSP spends in this block or tx
+    std::vector<CBigNum> vTxSerials;
+    if (tx.HasZerocoinSpendInputs()) {
+        int nHeightTx = 0;
+        if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+            return false;
+
+        for (const CTxIn& txIn : tx.vin) {
+            bool isPublicSpend = txIn.IsZerocoinPublicSpend();
+            if (!txIn.IsZerocoinSpend() && !isPublicSpend)
+                continue;
+
+            CBigNum bnSerial;
+            bool fValidSerial;
+            if (isPublicSpend) {
+                libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+                PublicCoinSpend publicSpend(params);
+                CValidationState state;
+                if (!ZWSPModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
+                    throw std::runtime_error("Invalid public spend parse");
+                }
+                bnSerial = publicSpend.getCoinSerialNumber();
+                bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(bnSerial) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                fValidSerial = publicSpend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params));
+            } else {
+                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
+                bnSerial = spend.getCoinSerialNumber();
+                bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(bnSerial) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                fValidSerial = spend.HasValidSerial(Params().Zerocoin_Params(fUseV1Params));
+            }
+
+            //This zWSP serial has already been included in the block, do not add this tx.
+            if (!fValidSerial || std::count(vSerials.begin(), vSerials.end(), bnSerial) || std::count(vTxSerials.begin(), vTxSerials.end(), bnSerial))
+                return false;
+            vTxSerials.emplace_back(bnSerial);
+        }
+    } else {
+        //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+        for (const CTxIn& txin : tx.vin) {
+            if (invalid_out::ContainsOutPoint(txin.prevout)) {
+                LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                return false;
+            }
+        }
+    }
+
+    nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+    nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, view);
+    if (nTxSigOps >= nSigOpsLeft)
+        return false;
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+
+    CValidationState state;
+    if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        return false;
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, nHeight);
+
+    vSerials.insert(vSerials.end(), vTxSerials.begin(), vTxSerials.end());
+    return true;
+}
+
 std::pair<int, std::pair<uint256, uint256> > pCheckpointCache;
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
 {
@@ -203,266 +336,257 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (auto mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
-            }
+        // Collect transactions into block
+        uint64_t nBlockSize = 1000;
+        uint64_t nBlockTx = 0;
+        int nBlockSigOps = 100;
+        unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+        std::set<uint256> setInBlock;
+        std::vector<CBigNum> vBlockSerials;
 
-            COrphan* porphan = nullptr;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            uint256 txid = tx.GetHash();
-            bool hasZerocoinSpends = tx.HasZerocoinSpendInputs();
-            if (hasZerocoinSpends)
-                nTotalIn = tx.GetZerocoinSpent();
-
-            for (const CTxIn& txin : tx.vin) {
-                //zerocoinspend has special vin
-                if (hasZerocoinSpends) {
-                    //Give a high priority to zerocoinspends to get into the next block
-                    //Priority = (age^6+100000)*amount - gives higher priority to zwsps that have been in mempool long
-                    //and higher priority to zwsps that are large in value
-                    int64_t nTimeSeen = GetAdjustedTime();
-                    double nConfs = 100000;
-
-                    auto it = mapZerocoinspends.find(txid);
-                    if (it != mapZerocoinspends.end()) {
-                        nTimeSeen = it->second;
-                    } else {
-                        //for some reason not in map, add it
-                        mapZerocoinspends[txid] = nTimeSeen;
-                    }
+        // Package totals of the transactions with ancestors in the block
+        std::map<uint256, CModifiedPackage> mapModified;
+        std::set<CModifiedPackage, CompareModifiedPackage> setModified;
 
-                    double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
+        auto addToBlock = [&](const CTxMemPoolEntry& entry, CAmount nTxFees, unsigned int nTxSigOps) {
+            const CTransaction& tx = entry.GetTx();
+            const uint256& hash = tx.GetHash();
+            pblock->vtx.push_back(tx);
+            pblocktemplate->vTxFees.push_back(nTxFees);
+            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+            nBlockSize += entry.GetTxSize();
+            ++nBlockTx;
+            nBlockSigOps += nTxSigOps;
+            nFees += nTxFees;
+            setInBlock.insert(hash);
 
-                    // zWSP spends can have very large priority, use non-overflowing safe functions
-                    dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
-                    dPriority = double_safe_multiplication(dPriority, nTotalIn);
+            auto itModified = mapModified.find(hash);
+            if (itModified != mapModified.end()) {
+                setModified.erase(itModified->second);
+                mapModified.erase(itModified);
+            }
 
+            // Descendants have this transaction less left to include
+            std::set<uint256> setDescendants;
+            mempool.CalculateDescendants(hash, setDescendants);
+            for (const uint256& hashDescendant : setDescendants) {
+                if (setInBlock.count(hashDescendant))
                     continue;
+                auto it = mapModified.find(hashDescendant);
+                if (it == mapModified.end()) {
+                    it = mapModified.insert(std::make_pair(hashDescendant, CModifiedPackage(&mempool.mapTx.find(hashDescendant)->second))).first;
+                } else {
+                    setModified.erase(it->second);
                 }
-
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == nullptr);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.emplace_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+                it->second.nSizeWithAncestors -= entry.GetTxSize();
+                it->second.nModFeesWithAncestors -= entry.GetModifiedFee();
+                it->second.nSigOpsWithAncestors -= entry.GetSigOpCount();
+                setModified.insert(it->second);
+            }
+        };
+
+        // How much of the block is filled by priority, regardless of fees
+        if (nBlockPrioritySize > 0) {
+            // This vector will be sorted into a priority queue:
+            std::vector<TxPriority> vecPriority;
+            vecPriority.reserve(mempool.mapTx.size());
+            for (const auto& mi : mempool.mapTx) {
+                const CTransaction& tx = mi.second.GetTx();
+                if (!IsTxEligibleForBlock(tx, nHeight))
                     continue;
-                }
-
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (invalid_out::ContainsOutPoint(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
-                }
 
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
+                double dPriority = tx.HasZerocoinSpendInputs() ? GetZerocoinSpendPriority(tx, mi.second.GetTxSize()) : mi.second.GetPriority(nHeight);
+                CAmount nFeeDelta = 0;
+                mempool.ApplyDeltas(mi.first, dPriority, nFeeDelta);
+                vecPriority.push_back(TxPriority(dPriority, CFeeRate(mi.second.GetModifiedFee(), mi.second.GetTxSize()), &tx));
+            }
 
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
+            TxPriorityCompare comparer(false);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+            // Transactions waiting for an in-mempool parent to be included first
+            std::multimap<uint256, TxPriority> mapWaitingOnParent;
+            while (!vecPriority.empty()) {
+                // Take highest priority transaction off the priority queue:
+                TxPriority txPriority = vecPriority.front();
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
+
+                double dPriority = txPriority.get<0>();
+                const CTransaction& tx = *(txPriority.get<2>());
+                const uint256& hash = tx.GetHash();
+                const CTxMemPoolEntry& entry = mempool.mapTx.find(hash)->second;
+                unsigned int nTxSize = entry.GetTxSize();
+
+                // Prioritise by fee once past the priority size or we run out of high-priority
+                // transactions:
+                if ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))
+                    break;
 
-                int nConf = nHeight - coins->nHeight;
+                bool fWaiting = false;
+                for (const uint256& hashParent : mempool.GetMemPoolParents(hash)) {
+                    if (!setInBlock.count(hashParent)) {
+                        mapWaitingOnParent.insert(std::make_pair(hashParent, txPriority));
+                        fWaiting = true;
+                        break;
+                    }
+                }
+                if (fWaiting)
+                    continue;
 
-                // zWSP spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
+                // Size limits
+                if (nBlockSize + nTxSize >= nBlockMaxSize)
+                    continue;
 
-            }
-            if (fMissingInputs) continue;
+                // Legacy limits on sigOps:
+                if (nBlockSigOps + entry.GetSigOpCount() >= nMaxBlockSigOps)
+                    continue;
 
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
+                CAmount nTxFees;
+                unsigned int nTxSigOps;
+                if (!TestTxForBlock(tx, nHeight, view, vBlockSerials, nMaxBlockSigOps - nBlockSigOps, nTxFees, nTxSigOps))
+                    continue;
 
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+                addToBlock(entry, nTxFees, nTxSigOps);
 
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
+                if (fPrintPriority) {
+                    LogPrintf("priority %.1f fee %s txid %s\n",
+                              dPriority, txPriority.get<1>().ToString(), hash.ToString());
+                }
 
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else{
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+                // Add transactions that depend on this one to the priority queue
+                auto range = mapWaitingOnParent.equal_range(hash);
+                for (auto it = range.first; it != range.second; ++it) {
+                    vecPriority.push_back(it->second);
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                }
+                mapWaitingOnParent.erase(range.first, range.second);
             }
         }
 
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
+        // Fill the rest of the block by package fee rate, from the mempool index and the packages
+        // with ancestors in the block
+        std::set<uint256> setFailed;
+        int nConsecutiveFailed = 0;
+        auto mi = mempool.setAncestorScore.begin();
+        while (mi != mempool.setAncestorScore.end() || !setModified.empty()) {
+            if (mi != mempool.setAncestorScore.end()) {
+                const uint256& hashEntry = (*mi)->GetTx().GetHash();
+                if (setInBlock.count(hashEntry) || setFailed.count(hashEntry) || mapModified.count(hashEntry)) {
+                    ++mi;
+                    continue;
+                }
+            }
 
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            bool fModified;
+            CModifiedPackage package = setModified.empty() ? CModifiedPackage(*mi) : *setModified.begin();
+            if (setModified.empty()) {
+                fModified = false;
+                ++mi;
+            } else if (mi == mempool.setAncestorScore.end() || CompareModifiedPackage()(package, CModifiedPackage(*mi))) {
+                fModified = true;
+                setModified.erase(setModified.begin());
+                mapModified.erase(package.entry->GetTx().GetHash());
+            } else {
+                fModified = false;
+                package = CModifiedPackage(*mi);
+                ++mi;
+            }
 
-        std::vector<CBigNum> vBlockSerials;
-        std::vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
+            const uint256& hashTip = package.entry->GetTx().GetHash();
+            if (fModified && setFailed.count(hashTip))
                 continue;
 
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
+            // Skip free transactions if we're past the minimum block size, the rest pays even less
+            CFeeRate packageFeeRate(package.nModFeesWithAncestors, package.nSizeWithAncestors);
+            if (packageFeeRate < ::minRelayTxFee && (nBlockSize + package.nSizeWithAncestors >= nBlockMinSize))
+                break;
 
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.HasZerocoinSpendInputs() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            if (nBlockSize + package.nSizeWithAncestors >= nBlockMaxSize || nBlockSigOps + package.nSigOpsWithAncestors >= nMaxBlockSigOps) {
+                if (fModified)
+                    setFailed.insert(hashTip);
+                // Stop once the block is nearly full and nothing fits anymore
+                if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 4000)
+                    break;
                 continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
             }
 
-            if (!view.HaveInputs(tx))
-                continue;
-
-            // double check that there are no double spent zWSP spends in this block or tx
-            if (tx.HasZerocoinSpendInputs()) {
-                int nHeightTx = 0;
-                if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+            // The package, parents first
+            std::set<uint256> setAncestors;
+            mempool.CalculateAncestors(hashTip, setAncestors);
+            std::vector<const CTxMemPoolEntry*> vPackage(1, package.entry);
+            bool fFailed = false;
+            for (const uint256& hashAncestor : setAncestors) {
+                if (setInBlock.count(hashAncestor))
                     continue;
-
-                bool fDoubleSerial = false;
-                for (const CTxIn& txIn : tx.vin) {
-                    bool isPublicSpend = txIn.IsZerocoinPublicSpend();
-                    if (txIn.IsZerocoinSpend() || isPublicSpend) {
-                        libzerocoin::CoinSpend* spend;
-                        if (isPublicSpend) {
-                            libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
-                            PublicCoinSpend publicSpend(params);
-                            CValidationState state;
-                            if (!ZWSPModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
-                                throw std::runtime_error("Invalid public spend parse");
-                            }
-                            spend = &publicSpend;
-                        } else {
-                            libzerocoin::CoinSpend spendObj = TxInToZerocoinSpend(txIn);
-                            spend = &spendObj;
-                        }
-
-                        bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend->getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
-                        if (!spend->HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
-                            fDoubleSerial = true;
-                        if (std::count(vBlockSerials.begin(), vBlockSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (std::count(vTxSerials.begin(), vTxSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (fDoubleSerial)
-                            break;
-                        vTxSerials.emplace_back(spend->getCoinSerialNumber());
-                    }
+                if (setFailed.count(hashAncestor)) {
+                    fFailed = true;
+                    break;
                 }
-                //This zWSP serial has already been included in the block, do not add this tx.
-                if (fDoubleSerial){
-                    continue;
+                vPackage.push_back(&mempool.mapTx.find(hashAncestor)->second);
+            }
+            std::sort(vPackage.begin(), vPackage.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+                return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+            });
+
+            // Check the whole package on its own view, so that a failure leaves the block untouched
+            CCoinsViewCache viewPackage(&view);
+            std::vector<CBigNum> vSerials(vBlockSerials);
+            std::vector<CAmount> vTxFees;
+            std::vector<unsigned int> vTxSigOps;
+            unsigned int nPackageSigOps = 0;
+            for (unsigned int i = 0; i < vPackage.size() && !fFailed; i++) {
+                const CTransaction& tx = vPackage[i]->GetTx();
+                CAmount nTxFees;
+                unsigned int nTxSigOps;
+                if (!IsTxEligibleForBlock(tx, nHeight) ||
+                    !TestTxForBlock(tx, nHeight, viewPackage, vSerials, nMaxBlockSigOps - nBlockSigOps - nPackageSigOps, nTxFees, nTxSigOps)) {
+                    setFailed.insert(tx.GetHash());
+                    fFailed = true;
+                    break;
                 }
+                vTxFees.push_back(nTxFees);
+                vTxSigOps.push_back(nTxSigOps);
+                nPackageSigOps += nTxSigOps;
             }
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps){
+            if (fFailed) {
+                setFailed.insert(hashTip);
                 continue;
             }
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
+            viewPackage.Flush();
+            vBlockSerials.swap(vSerials);
+            nConsecutiveFailed = 0;
+            for (unsigned int i = 0; i < vPackage.size(); i++) {
+                addToBlock(*vPackage[i], vTxFees[i], vTxSigOps[i]);
 
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)){
-                continue;
+                if (fPrintPriority) {
+                    LogPrintf("fee %s package fee %s txid %s\n",
+                              CFeeRate(vPackage[i]->GetModifiedFee(), vPackage[i]->GetTxSize()).ToString(), packageFeeRate.ToString(),
+                              vPackage[i]->GetTx().GetHash().ToString());
+                }
             }
+        }
 
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
+        // zWSP spends don't need to pay a fee, add those left out while there is room
+        for (const auto& it : mapZerocoinspends) {
+            auto itTx = mempool.mapTx.find(it.first);
+            if (itTx == mempool.mapTx.end() || setInBlock.count(it.first) || setFailed.count(it.first) || !mempool.GetMemPoolParents(it.first).empty())
+                continue;
 
-            for (const CBigNum& bnSerial : vTxSerials){
-                vBlockSerials.emplace_back(bnSerial);
-            }
+            const CTxMemPoolEntry& entry = itTx->second;
+            if (nBlockSize + entry.GetTxSize() >= nBlockMaxSize || nBlockSigOps + entry.GetSigOpCount() >= nMaxBlockSigOps)
+                continue;
 
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
+            CAmount nTxFees;
+            unsigned int nTxSigOps;
+            if (!IsTxEligibleForBlock(entry.GetTx(), nHeight) ||
+                !TestTxForBlock(entry.GetTx(), nHeight, view, vBlockSerials, nMaxBlockSigOps - nBlockSigOps, nTxFees, nTxSigOps))
+                continue;
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.emplace_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
+            addToBlock(entry, nTxFees, nTxSigOps);
         }
 
         if (!fProofOfStake) {
@@ -641,7 +765,7 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
 
     // Process this block the same as if we had received it from another node
     CValidationState state;
-    if (!ProcessNewBlock(state, nullptr, pblock)) {
+    if (!ProcessNewBlock(state, nullptr, std::make_shared<CBlock>(*pblock))) {
         if (pblock->IsZerocoinStake()) {
             pwalletMain->zwspTracker->RemovePending(pblock->vtx[1].GetHash());
             pwalletMain->zwspTracker->ListMints(true, true, true); //update the state
@@ -722,6 +846,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         //
         // Create new block
         //
+        // Stake only from coins the wallet already knows to be unspent
+        SyncWithValidationInterfaceQueue();
         unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrev = chainActive.Tip();
         if (!pindexPrev){
@@ -26,6 +26,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -36,6 +40,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
+#include <unordered_map>
+
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
@@ -832,9 +838,319 @@ void SocketSendData(CNode* pnode)
 
 static std::list<CNode*> vNodesDisconnected;
 
+/** Milliseconds the socket handler waits for socket events before checking the send buffers again */
+static const int SOCKET_EVENT_TIMEOUT = 50;
+/** Maximum number of events taken from epoll in one wait */
+static const int MAX_SOCKET_EVENTS = 256;
+
+/**
+ * Whether the socket handler should wait for pnode's socket to become writable or readable:
+ * * If there is data to send, wait for sending data. As this only happens when an optimistic
+ *   write failed, we choose to first drain the write buffer in this case before receiving more.
+ *   This avoids needlessly queueing received data if the remote peer is not itself receiving
+ *   data, which makes proper use of TCP flow control signalling.
+ * * Otherwise, if there is no (complete) message in the receive buffer, or there is space left
+ *   in the buffer, wait for receiving data.
+ * * If neither of the above applies, there is certainly one message in the receive buffer
+ *   ready to be processed.
+ * Together, that means that at least one of the following is always possible, so we don't
+ * deadlock: we send some data, we wait for data to be received (and disconnect after timeout),
+ * or we process a message in the buffer (message handler thread).
+ */
+static void GetSocketInterest(CNode* pnode, bool& fSend, bool& fRecv)
+{
+    fSend = false;
+    fRecv = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+            fRecv = true;
+    }
+}
+
+/** Read what the socket of pnode has ready. Returns whether it may have more. Requires cs_vRecvMsg. */
+static bool SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0) {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        // A short read emptied the socket buffer; Linux reports data arriving after it as a new edge
+        return nBytes == (int)sizeof(pchBuf);
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+#ifdef USE_EPOLL
+/**
+ * Sockets are registered once, edge-triggered, and the kernel only reports the ones that
+ * changed. What a node wants to do with its socket is decided when it's serviced, from the
+ * readiness remembered in fSocketRecvReady and fSocketSendReady. Only the nodes that have
+ * some of it left are serviced, so idle peers cost nothing per wake-up.
+ */
+class CSocketEventsEpoll
+{
+private:
+    int hEpoll;
+    //! Nodes by the socket they are registered under
+    std::unordered_map<SOCKET, CNode*> mapNodes;
+    //! Registered nodes with fSocketRecvReady or fSocketSendReady set
+    std::vector<CNode*> vReady;
+
+    void SetReady(CNode* pnode, bool fRecv, bool fSend)
+    {
+        if (!pnode->fSocketRecvReady && !pnode->fSocketSendReady && (fRecv || fSend))
+            vReady.push_back(pnode);
+        pnode->fSocketRecvReady |= fRecv;
+        pnode->fSocketSendReady |= fSend;
+    }
+
+public:
+    CSocketEventsEpoll()
+    {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1) {
+            LogPrintf("epoll_create1 failed: %s, using poll()\n", NetworkErrorString(errno));
+            return;
+        }
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            // Level-triggered, as accept() takes one connection at a time
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = hListenSocket.socket;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1)
+                LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(errno));
+        }
+    }
+
+    ~CSocketEventsEpoll()
+    {
+        if (hEpoll != -1)
+            close(hEpoll);
+    }
+
+    bool IsValid() const { return hEpoll != -1; }
+
+    void Register(CNode* pnode)
+    {
+        if (pnode->hSocket == INVALID_SOCKET || pnode->hSocketRegistered == pnode->hSocket)
+            return;
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = pnode->hSocket;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+            LogPrint("net", "epoll_ctl failed for peer=%d: %s\n", pnode->id, NetworkErrorString(errno));
+            return;
+        }
+        mapNodes[pnode->hSocket] = pnode;
+        pnode->hSocketRegistered = pnode->hSocket;
+        // A socket that is already readable or writable is reported by the next wait. Data that
+        // came in before is read once anyway; sending needs no edge, as the first message
+        // queued on an empty send buffer is written right away.
+        SetReady(pnode, true, false);
+    }
+
+    /** Forget a node before it is deleted. Its socket may already be closed, which unregistered it. */
+    void Unregister(CNode* pnode)
+    {
+        if (pnode->hSocketRegistered == INVALID_SOCKET)
+            return;
+        auto it = mapNodes.find(pnode->hSocketRegistered);
+        if (it != mapNodes.end() && it->second == pnode) {
+            if (pnode->hSocket != INVALID_SOCKET)
+                epoll_ctl(hEpoll, EPOLL_CTL_DEL, pnode->hSocket, nullptr);
+            mapNodes.erase(it);
+        }
+        vReady.erase(std::remove(vReady.begin(), vReady.end(), pnode), vReady.end());
+        pnode->hSocketRegistered = INVALID_SOCKET;
+    }
+
+    void Wait(int nTimeout, std::set<SOCKET>& setListenReady)
+    {
+        struct epoll_event events[MAX_SOCKET_EVENTS];
+        int nEvents = epoll_wait(hEpoll, events, MAX_SOCKET_EVENTS, nTimeout);
+        if (nEvents == -1) {
+            if (errno != EINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(nTimeout);
+            }
+            return;
+        }
+        for (int i = 0; i < nEvents; i++) {
+            SOCKET hSocket = events[i].data.fd;
+            auto it = mapNodes.find(hSocket);
+            if (it == mapNodes.end()) {
+                setListenReady.insert(hSocket);
+                continue;
+            }
+            // Reported for a socket that was closed and reused since
+            CNode* pnode = it->second;
+            if (pnode->hSocket != hSocket)
+                continue;
+            uint32_t nFlags = events[i].events;
+            SetReady(pnode, nFlags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR), nFlags & (EPOLLOUT | EPOLLHUP | EPOLLERR));
+        }
+    }
+
+    /** Nodes to service after a wait. All of them are registered, so they are in vNodes. */
+    const std::vector<CNode*>& GetReady() const { return vReady; }
+
+    /** Drop the nodes whose readiness was used up while they were serviced */
+    void PruneReady()
+    {
+        vReady.erase(std::remove_if(vReady.begin(), vReady.end(), [](CNode* pnode) {
+            return pnode->hSocket == INVALID_SOCKET || (!pnode->fSocketRecvReady && !pnode->fSocketSendReady);
+        }), vReady.end());
+    }
+};
+#endif
+
+/** Level-triggered wait over every socket the nodes are interested in, reporting only the ready ones */
+static void WaitForSocketEvents(const std::vector<CNode*>& vNodesCopy, int nTimeout, std::set<SOCKET>& setListenReady)
+{
+#ifdef USE_POLL
+    std::vector<struct pollfd> vPollFds;
+    std::vector<CNode*> vPollNodes;
+    vPollFds.reserve(vhListenSocket.size() + vNodesCopy.size());
+    vPollNodes.reserve(vNodesCopy.size());
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        struct pollfd pollfd;
+        pollfd.fd = hListenSocket.socket;
+        pollfd.events = POLLIN;
+        pollfd.revents = 0;
+        vPollFds.push_back(pollfd);
+    }
+    for (CNode* pnode : vNodesCopy) {
+        pnode->fSocketRecvReady = false;
+        pnode->fSocketSendReady = false;
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        bool fSend, fRecv;
+        GetSocketInterest(pnode, fSend, fRecv);
+        struct pollfd pollfd;
+        pollfd.fd = pnode->hSocket;
+        // Errors and hang-ups are reported without asking
+        pollfd.events = (fSend ? POLLOUT : 0) | (fRecv ? POLLIN : 0);
+        pollfd.revents = 0;
+        vPollFds.push_back(pollfd);
+        vPollNodes.push_back(pnode);
+    }
+
+    int nRet = poll(vPollFds.data(), vPollFds.size(), nTimeout);
+    boost::this_thread::interruption_point();
+    if (nRet == SOCKET_ERROR) {
+        LogPrintf("socket poll error %s\n", NetworkErrorString(WSAGetLastError()));
+        MilliSleep(nTimeout);
+        return;
+    }
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        if (vPollFds[i].revents & POLLIN)
+            setListenReady.insert(vPollFds[i].fd);
+    }
+    for (size_t i = 0; i < vPollNodes.size(); i++) {
+        short nFlags = vPollFds[vhListenSocket.size() + i].revents;
+        vPollNodes[i]->fSocketRecvReady = nFlags & (POLLIN | POLLHUP | POLLERR);
+        vPollNodes[i]->fSocketSendReady = nFlags & POLLOUT;
+    }
+#else
+    struct timeval timeout = MillisToTimeval(nTimeout);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    for (CNode* pnode : vNodesCopy) {
+        pnode->fSocketRecvReady = false;
+        pnode->fSocketSendReady = false;
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        FD_SET(pnode->hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, pnode->hSocket);
+        have_fds = true;
+
+        bool fSend, fRecv;
+        GetSocketInterest(pnode, fSend, fRecv);
+        if (fSend)
+            FD_SET(pnode->hSocket, &fdsetSend);
+        if (fRecv)
+            FD_SET(pnode->hSocket, &fdsetRecv);
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+        &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (CNode* pnode : vNodesCopy)
+                pnode->fSocketRecvReady = true;
+        }
+        MilliSleep(nTimeout);
+        return;
+    }
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            setListenReady.insert(hListenSocket.socket);
+    }
+    for (CNode* pnode : vNodesCopy) {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        pnode->fSocketRecvReady = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+        pnode->fSocketSendReady = FD_ISSET(pnode->hSocket, &fdsetSend);
+    }
+#endif
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
+    bool fMoreData = false;
+#ifdef USE_EPOLL
+    CSocketEventsEpoll epoll;
+#endif
     while (true) {
         //
         // Disconnect nodes
@@ -852,6 +1168,11 @@ void ThreadSocketHandler()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
+#ifdef USE_EPOLL
+                    if (epoll.IsValid())
+                        epoll.Unregister(pnode);
+#endif
+
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
 
@@ -897,89 +1218,35 @@ void ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
+        std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
+            vNodesCopy = vNodes;
+            for (CNode* pnode : vNodesCopy)
+                pnode->AddRef();
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
+        //
+        // Find which sockets have data to receive or room to send; don't wait when a
+        // socket is known to have more data than the last read took
+        //
+        int nTimeout = fMoreData ? 0 : SOCKET_EVENT_TIMEOUT; // frequency to poll pnode->vSend
+        std::set<SOCKET> setListenReady;
+#ifdef USE_EPOLL
+        if (epoll.IsValid()) {
+            for (CNode* pnode : vNodesCopy)
+                epoll.Register(pnode);
+            epoll.Wait(nTimeout, setListenReady);
+            boost::this_thread::interruption_point();
+        } else
+#endif
+            WaitForSocketEvents(vNodesCopy, nTimeout, setListenReady);
 
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && setListenReady.count(hListenSocket.socket)) {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -1025,51 +1292,32 @@ void ThreadSocketHandler()
         }
 
         //
-        // Service each socket
+        // Service each socket that is ready for what its node wants to do
         //
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
-        }
-        for (CNode* pnode : vNodesCopy) {
+        fMoreData = false;
+        std::vector<CNode*> vServiceNodes;
+#ifdef USE_EPOLL
+        if (epoll.IsValid())
+            vServiceNodes = epoll.GetReady();
+        else
+#endif
+            vServiceNodes = vNodesCopy;
+        for (CNode* pnode : vServiceNodes) {
             boost::this_thread::interruption_point();
 
+            if (pnode->hSocket == INVALID_SOCKET || !(pnode->fSocketRecvReady || pnode->fSocketSendReady))
+                continue;
+            bool fSend, fRecv;
+            GetSocketInterest(pnode, fSend, fRecv);
+
             //
             // Receive
             //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (fRecv && pnode->fSocketRecvReady) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
+                    pnode->fSocketRecvReady = SocketRecvData(pnode);
+                    fMoreData |= pnode->fSocketRecvReady;
                 }
             }
 
@@ -1078,29 +1326,43 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pnode->fSocketSendReady) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    SocketSendData(pnode);
+                if (lockSend) {
+                    if (!pnode->vSendMsg.empty())
+                        SocketSendData(pnode);
+                    // Whatever is left didn't fit in the socket buffer, so wait for it to drain. With
+                    // nothing left, the next message queued is sent right away without waiting.
+                    pnode->fSocketSendReady = false;
+                }
             }
+        }
+#ifdef USE_EPOLL
+        if (epoll.IsValid())
+            epoll.PruneReady();
+#endif
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
+        //
+        // Inactivity checking, once a second
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+            for (CNode* pnode : vNodesCopy) {
+                if (nTime - pnode->nTimeConnected > 60) {
+                    if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+                        LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+                        LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+                        LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+                        pnode->fDisconnect = true;
+                    } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+                        LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+                        pnode->fDisconnect = true;
+                    }
                 }
             }
         }
@@ -1112,7 +1374,6 @@ void ThreadSocketHandler()
     }
 }
 
-
 #ifdef USE_UPNP
 void ThreadMapPort()
 {
@@ -2031,6 +2292,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, const std::string& addrNameIn, b
 {
     nServices = 0;
     hSocket = hSocketIn;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
+    hSocketRegistered = INVALID_SOCKET;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
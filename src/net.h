@@ -287,6 +287,11 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
+    //! Readiness of hSocket seen by the socket handler thread, which is the only one using these
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
+    //! Socket registered for this node with the socket handler's epoll instance
+    SOCKET hSocketRegistered;
     CDataStream ssSend;
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
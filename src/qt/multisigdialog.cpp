@@ -379,7 +379,9 @@ bool MultisigDialog::createMultisigTransaction(std::vector<CTxIn> vUserIn, std::
 {
     try{
         //attempt to access the given inputs
-        CCoinsViewCache view = getInputsCoinsViewCache(vUserIn);
+        CCoinsView viewDummy;
+        CCoinsViewCache view(&viewDummy);
+        getInputsCoinsViewCache(vUserIn, view, viewDummy);
 
         //retrieve total input val and change dest
         CAmount totalIn = 0;
@@ -388,11 +390,11 @@ bool MultisigDialog::createMultisigTransaction(std::vector<CTxIn> vUserIn, std::
         bool fFirst = true;
 
         for(CTxIn in : vUserIn){
-            const CCoins* coins = view.AccessCoins(in.prevout.hash);
-            if(!coins->IsAvailable(in.prevout.n) || coins == NULL){
+            const Coin& coin = view.AccessCoin(in.prevout);
+            if(coin.IsSpent()){
                 continue;
             }
-            CTxOut prevout = coins->vout[in.prevout.n];
+            CTxOut prevout = coin.out;
             CScript privKey = prevout.scriptPubKey;
 
             vInputVals.push_back(prevout.nValue);
@@ -438,13 +440,13 @@ bool MultisigDialog::createMultisigTransaction(std::vector<CTxIn> vUserIn, std::
         tx.vin = vUserIn;
         tx.vout = vUserOut;
 
-        const CCoins* coins = view.AccessCoins(tx.vin[0].prevout.hash);
+        const Coin& coin = view.AccessCoin(tx.vin[0].prevout);
 
-        if(coins == NULL || !coins->IsAvailable(tx.vin[0].prevout.n)){
+        if(coin.IsSpent()){
             throw std::runtime_error("Coins unavailable (unconfirmed/spent)");
         }
 
-        CScript prevPubKey = coins->vout[tx.vin[0].prevout.n].scriptPubKey;
+        CScript prevPubKey = coin.out.scriptPubKey;
 
         //get payment destination
         CTxDestination address;
@@ -563,10 +565,8 @@ QString MultisigDialog::buildMultisigTxStatusString(bool fComplete, const CMutab
 }
 
 
-CCoinsViewCache MultisigDialog::getInputsCoinsViewCache(const std::vector<CTxIn>& vin)
+void MultisigDialog::getInputsCoinsViewCache(const std::vector<CTxIn>& vin, CCoinsViewCache& view, CCoinsView& viewBackend)
 {
-    CCoinsView viewDummy;
-    CCoinsViewCache view(&viewDummy);
     {
         LOCK(mempool.cs);
         CCoinsViewCache& viewChain = *pcoinsTip;
@@ -574,14 +574,11 @@ CCoinsViewCache MultisigDialog::getInputsCoinsViewCache(const std::vector<CTxIn>
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
         for(const CTxIn& txin : vin) {
-            const uint256& prevHash = txin.prevout.hash;
-            view.AccessCoins(prevHash); // this is certainly allowed to fail
+            view.AccessCoin(txin.prevout); // this is certainly allowed to fail
         }
 
-        view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
+        view.SetBackend(viewBackend); // switch back to avoid locking mempool for too long
     }
-
-    return view;
 }
 
 
@@ -731,10 +728,12 @@ void MultisigDialog::commitMultisigTx()
 #else
         uint256 hashTx = tx.GetHash();
         CCoinsViewCache& view = *pcoinsTip;
-        const CCoins* existingCoins = view.AccessCoins(hashTx);
         bool fOverrideFees = false;
         bool fHaveMempool = mempool.exists(hashTx);
-        bool fHaveChain = existingCoins && existingCoins->nHeight < 1000000000;
+        bool fHaveChain = false;
+        for (size_t o = 0; !fHaveChain && o < tx.vout.size(); o++) {
+            fHaveChain = !view.AccessCoin(COutPoint(hashTx, o)).IsSpent();
+        }
 
         if (!fHaveMempool && !fHaveChain) {
             // push to local node and sync with wallets
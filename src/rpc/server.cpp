@@ -15,6 +15,7 @@
 #include "guiinterface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
 
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
@@ -608,6 +609,9 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    // Commands see the wallet and other listeners caught up with the chain
+    SyncWithValidationInterfaceQueue();
+
     try {
         // Execute
         return pcmd->actor(params, false);
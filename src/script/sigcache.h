@@ -8,10 +8,32 @@
 
 #include "script/interpreter.h"
 
+#include <cstring>
 #include <vector>
 
+// Default and maximum of -maxsigcachesize, in MiB
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+/**
+ * Hashes for CuckooCache::cache keyed by uint256 values that are already
+ * salted hashes: the n-th hash is the n-th 32 bit word of the key.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -178,6 +178,13 @@ bool CWspStake::SetInput(const CTransaction& txPrev, unsigned int n)
     return true;
 }
 
+void CWspStake::SetIndexFrom(CBlockIndex* pindex, uint64_t nStakeModifierIn)
+{
+    this->pindexFrom = pindex;
+    this->nStakeModifier = nStakeModifierIn;
+    this->fStakeModifier = true;
+}
+
 bool CWspStake::GetTxFrom(CTransaction& tx)
 {
     tx = txFrom;
@@ -232,6 +239,11 @@ bool CWspStake::CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmoun
 
 bool CWspStake::GetModifier(uint64_t& nStakeModifier)
 {
+    if (fStakeModifier) {
+        nStakeModifier = this->nStakeModifier;
+        return true;
+    }
+
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
     GetIndexFrom();
@@ -255,6 +267,10 @@ CDataStream CWspStake::GetUniqueness()
 //The block that the UTXO was added to the chain
 CBlockIndex* CWspStake::GetIndexFrom()
 {
+    // Already resolved and still in the chain, no need to look the transaction up again
+    if (pindexFrom && chainActive.Contains(pindexFrom))
+        return pindexFrom;
+
     uint256 hashBlock = 0;
     CTransaction tx;
     if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
@@ -74,13 +74,19 @@ class CWspStake : public CStakeInput
 private:
     CTransaction txFrom;
     unsigned int nPosition;
+    //! Stake modifier already resolved by the wallet
+    bool fStakeModifier;
+    uint64_t nStakeModifier;
 public:
     CWspStake()
     {
         this->pindexFrom = nullptr;
+        this->fStakeModifier = false;
+        this->nStakeModifier = 0;
     }
 
     bool SetInput(const CTransaction& txPrev, unsigned int n);
+    void SetIndexFrom(CBlockIndex* pindex, uint64_t nStakeModifierIn);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
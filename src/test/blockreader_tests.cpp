@@ -0,0 +1,170 @@
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+#include "clientversion.h"
+#include "compressor.h"
+#include "hash.h"
+#include "main.h"
+#include "streams.h"
+#include "test/test_wispr.h"
+#include "undo.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockreader_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)0x01020304 << std::string("wispr");
+
+    std::vector<char> vch(ss.begin(), ss.end());
+    CSpanReader reader(vch.data(), vch.data() + vch.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "wispr");
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+
+    CSpanReader truncated(vch.data(), vch.data() + vch.size() - 1, SER_DISK, CLIENT_VERSION);
+    truncated >> n;
+    BOOST_CHECK_THROW(truncated >> str, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(read_block_and_undo_files)
+{
+    const int nFile = 99;
+    CBlock genesis = Params().GenesisBlock();
+    unsigned int nBlockSize = ::GetSerializeSize(genesis, SER_DISK, CLIENT_VERSION);
+
+    CDiskBlockPos pos1(nFile, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(genesis, pos1));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.emplace_back(genesis.vtx[0].vout[0], 1, true, false);
+    CDiskBlockPos posUndo(nFile, 0);
+    BOOST_REQUIRE(blockundo.WriteToDisk(posUndo, genesis.GetHash()));
+
+    for (bool fMmap : {false, true}) {
+        blockFileReader.SetUseMmap(fMmap);
+
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pos1));
+        BOOST_CHECK(block.GetHash() == genesis.GetHash());
+
+        // Append after the file is already open (and mapped); the reader has to pick up the new size
+        CDiskBlockPos pos2(nFile, pos1.nPos + nBlockSize);
+        BOOST_REQUIRE(WriteBlockToDisk(genesis, pos2));
+        BOOST_CHECK(pos2.nPos == pos1.nPos + nBlockSize + 8);
+        BOOST_CHECK(ReadBlockFromDisk(block, pos2));
+        BOOST_CHECK(block.GetHash() == genesis.GetHash());
+
+        // Positions that do not start a record are rejected rather than misread
+        BOOST_CHECK(!ReadBlockFromDisk(block, CDiskBlockPos(nFile, 4)));
+        BOOST_CHECK(!ReadBlockFromDisk(block, CDiskBlockPos(nFile, pos1.nPos + 1)));
+        BOOST_CHECK(!ReadBlockFromDisk(block, CDiskBlockPos(nFile, pos2.nPos + nBlockSize + 8)));
+        BOOST_CHECK(!ReadBlockFromDisk(block, CDiskBlockPos(nFile + 1, 8)));
+
+        CBlockUndo undo;
+        BOOST_CHECK(undo.ReadFromDisk(posUndo, genesis.GetHash()));
+        BOOST_CHECK_EQUAL(undo.vtxundo.size(), 2U);
+        BOOST_CHECK_EQUAL(undo.vtxundo[0].vprevout.size(), 1U);
+        BOOST_CHECK(undo.vtxundo[0].vprevout[0].out == genesis.vtx[0].vout[0]);
+        BOOST_CHECK(!undo.ReadFromDisk(posUndo, uint256()));
+
+        BOOST_CHECK_EQUAL(blockFileReader.OpenFiles(), 2U);
+        blockFileReader.Close(nFile);
+        BOOST_CHECK_EQUAL(blockFileReader.OpenFiles(), 0U);
+    }
+
+    blockFileReader.SetUseMmap(DEFAULT_BLOCK_MMAP);
+}
+
+BOOST_AUTO_TEST_CASE(read_old_format_undo)
+{
+    const int nFile = 96;
+    CBlock genesis = Params().GenesisBlock();
+    const CTxOut& out = genesis.vtx[0].vout[0];
+
+    // Older versions wrote the transaction version after the metadata of a last spend, where 0 is written now
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(ssUndo, 1);
+    WriteCompactSize(ssUndo, 1);
+    ssUndo << VARINT(5 * 4 + 2) << VARINT(1) << CTxOutCompressor(REF(out));
+    {
+        CAutoFile fileout(OpenUndoFile(CDiskBlockPos(nFile, 0)), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)ssUndo.size();
+        fileout.write(&ssUndo[0], ssUndo.size());
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << genesis.GetHash();
+        hasher.write(&ssUndo[0], ssUndo.size());
+        fileout << hasher.GetHash();
+    }
+
+    CBlockUndo undo;
+    BOOST_CHECK(undo.ReadFromDisk(CDiskBlockPos(nFile, 8), genesis.GetHash()));
+    BOOST_REQUIRE_EQUAL(undo.vtxundo.size(), 1U);
+    BOOST_REQUIRE_EQUAL(undo.vtxundo[0].vprevout.size(), 1U);
+    const Coin& coin = undo.vtxundo[0].vprevout[0];
+    BOOST_CHECK(coin.out == out);
+    BOOST_CHECK_EQUAL(coin.nHeight, 5);
+    BOOST_CHECK(coin.fCoinBase);
+    BOOST_CHECK(!coin.fCoinStake);
+
+    blockFileReader.Close(nFile);
+}
+
+BOOST_AUTO_TEST_CASE(read_preallocated_file)
+{
+    CBlock genesis = Params().GenesisBlock();
+    unsigned int nBlockSize = ::GetSerializeSize(genesis, SER_DISK, CLIENT_VERSION);
+
+    for (bool fMmap : {false, true}) {
+        // Block files are preallocated in chunks, so reads of the first record
+        // see zeros where later records will be written
+        const int nFile = fMmap ? 98 : 97;
+        FILE* file = OpenBlockFile(CDiskBlockPos(nFile, 0));
+        BOOST_REQUIRE(file);
+        AllocateFileRange(file, 0, 0x10000);
+        fclose(file);
+
+        blockFileReader.SetUseMmap(fMmap);
+        CDiskBlockPos pos1(nFile, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(genesis, pos1));
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pos1));
+        BOOST_CHECK(!ReadBlockFromDisk(block, CDiskBlockPos(nFile, pos1.nPos + nBlockSize + 8)));
+
+        CDiskBlockPos pos2(nFile, pos1.nPos + nBlockSize);
+        BOOST_REQUIRE(WriteBlockToDisk(genesis, pos2));
+        BOOST_CHECK(ReadBlockFromDisk(block, pos2));
+        BOOST_CHECK(block.GetHash() == genesis.GetHash());
+        blockFileReader.Close(nFile);
+    }
+
+    blockFileReader.SetUseMmap(DEFAULT_BLOCK_MMAP);
+}
+
+BOOST_AUTO_TEST_CASE(open_file_limit)
+{
+    CBlock genesis = Params().GenesisBlock();
+    CBlockFileReader reader(2);
+
+    for (int nFile = 90; nFile < 94; nFile++) {
+        CDiskBlockPos pos(nFile, 0);
+        BOOST_REQUIRE(WriteBlockToDisk(genesis, pos));
+        CBlockFileRecord record;
+        BOOST_CHECK(reader.Read(pos, "blk", 0, record));
+        BOOST_CHECK_EQUAL(record.size(), ::GetSerializeSize(genesis, SER_DISK, CLIENT_VERSION));
+        BOOST_CHECK(reader.OpenFiles() <= 2);
+    }
+    BOOST_CHECK_EQUAL(reader.OpenFiles(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
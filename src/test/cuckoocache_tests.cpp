@@ -0,0 +1,80 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "test_wispr.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+static std::vector<uint256> RandomHashes(size_t n)
+{
+    std::vector<uint256> vHashes(n);
+    for (uint256& hash : vHashes)
+        hash = GetRandHash();
+    return vHashes;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_empty)
+{
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    cc.setup_bytes(1 << 16);
+    for (const uint256& hash : RandomHashes(1000))
+        BOOST_CHECK(!cc.contains(hash, false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    uint32_t nSize = cc.setup_bytes(1 << 16);
+    BOOST_CHECK_EQUAL(nSize, (1 << 16) / sizeof(uint256));
+
+    // Half full: everything inserted is still there
+    std::vector<uint256> vHashes = RandomHashes(nSize / 2);
+    for (const uint256& hash : vHashes)
+        cc.insert(hash);
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(cc.contains(hash, false));
+
+    // Twice the capacity: the most recent inserts are mostly kept
+    std::vector<uint256> vMore = RandomHashes(nSize * 2);
+    for (const uint256& hash : vMore)
+        cc.insert(hash);
+    size_t nHits = 0;
+    for (size_t i = vMore.size() - nSize / 4; i < vMore.size(); i++)
+        nHits += cc.contains(vMore[i], false);
+    BOOST_CHECK(nHits > (nSize / 4) * 9 / 10);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    uint32_t nSize = cc.setup_bytes(1 << 16);
+
+    // Fill, then mark the first half collectable
+    std::vector<uint256> vHashes = RandomHashes(nSize);
+    for (const uint256& hash : vHashes)
+        cc.insert(hash);
+    size_t nFirstHalf = 0;
+    for (size_t i = 0; i < vHashes.size() / 2; i++)
+        nFirstHalf += cc.contains(vHashes[i], true);
+
+    // New inserts take the erased slots before evicting anything else
+    std::vector<uint256> vMore = RandomHashes(nFirstHalf / 2);
+    for (const uint256& hash : vMore)
+        cc.insert(hash);
+    size_t nSecondHalf = 0, nMore = 0;
+    for (size_t i = vHashes.size() / 2; i < vHashes.size(); i++)
+        nSecondHalf += cc.contains(vHashes[i], false);
+    for (const uint256& hash : vMore)
+        nMore += cc.contains(hash, false);
+    BOOST_CHECK(nMore > vMore.size() * 99 / 100);
+    BOOST_CHECK(nSecondHalf > (vHashes.size() / 2) * 8 / 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
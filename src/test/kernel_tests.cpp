@@ -0,0 +1,37 @@
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "random.h"
+#include "test_wispr.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_matches_checkstakev2)
+{
+    for (int i = 0; i < 50; i++) {
+        CDataStream ssUniqueID(SER_NETWORK, 0);
+        ssUniqueID << (uint32_t)insecure_rand() << GetRandHash();
+
+        CAmount nValueIn = GetRand(100000) * COIN;
+        uint64_t nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        unsigned int nTimeBlockFrom = 1500000000 + insecure_rand() % 10000000;
+        uint256 bnTargetPerCoinDay = GetRandHash() >> (40 + insecure_rand() % 24);
+
+        CStakeKernel kernel(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom);
+        for (unsigned int nTimeTx = nTimeBlockFrom + 3600; nTimeTx < nTimeBlockFrom + 3660; nTimeTx++) {
+            uint256 hashExpected;
+            unsigned int nTimeTry = nTimeTx;
+            bool fExpected = CheckStakeV2(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTimeTry, hashExpected);
+
+            uint256 hashProofOfStake;
+            BOOST_CHECK_EQUAL(kernel.CheckHash(nTimeTx, hashProofOfStake), fExpected);
+            BOOST_CHECK(hashProofOfStake == hashExpected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,7 +5,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "compressor.h"
 #include "main.h"
+#include "random.h"
+#include "txdb.h"
 #include "test_wispr.h"
 
 #include <boost/test/unit_test.hpp>
@@ -35,4 +38,152 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == nMoneySupplyPoWEnd);
 }
 
+BOOST_AUTO_TEST_CASE(load_block_index_guts)
+{
+    // A chain long enough that every reader thread gets a share of the key space
+    CBlockTreeDB blocktree(1 << 20, true);
+    std::vector<uint256> vHashes;
+    uint256 hashPrev;
+    for (int i = 0; i < 5000; i++) {
+        CDiskBlockIndex diskindex;
+        diskindex.nVersion = 8;
+        diskindex.nHeight = i + 1;
+        diskindex.nTime = i;
+        diskindex.SetProofOfStake();
+        diskindex.hashPrev = hashPrev;
+        diskindex.cold->zerocoinSupply.at(libzerocoin::ZQ_TEN) = i;
+        BOOST_CHECK(blocktree.WriteBlockIndex(diskindex));
+        hashPrev = diskindex.GetBlockHash();
+        vHashes.push_back(hashPrev);
+    }
+
+    BOOST_CHECK(blocktree.LoadBlockIndexGuts());
+    for (int i = 0; i < (int)vHashes.size(); i++) {
+        BlockMap::iterator mi = mapBlockIndex.find(vHashes[i]);
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        CBlockIndex* pindex = mi->second;
+        BOOST_CHECK(pindex->GetBlockHash() == vHashes[i]);
+        BOOST_CHECK_EQUAL(pindex->nHeight, i + 1);
+        BOOST_CHECK_EQUAL(pindex->GetZcMints(libzerocoin::ZQ_TEN), i);
+        if (i == 0)
+            BOOST_CHECK(pindex->pprev == nullptr);
+        else
+            BOOST_CHECK(pindex->pprev == mapBlockIndex[vHashes[i - 1]]);
+    }
+
+    for (const uint256& hash : vHashes)
+        mapBlockIndex.erase(hash);
+}
+
+BOOST_AUTO_TEST_CASE(apply_undo_of_mint_change)
+{
+    // A mint with change, in a block on disk that the transaction index points to
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(2);
+    mtx.vout[0] = CTxOut(10 * COIN, CScript() << OP_ZEROCOINMINT << std::vector<unsigned char>(32, 0x01));
+    mtx.vout[1] = CTxOut(3 * COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG);
+    CTransaction tx(mtx);
+
+    CBlock block = Params().GenesisBlock();
+    block.hashPrevBlock = block.GetHash();
+    block.vtx.push_back(tx);
+    CDiskBlockPos pos(80, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.emplace_back(tx.GetHash(), CDiskTxPos(pos, GetSizeOfCompactSize(block.vtx.size()) + ::GetSerializeSize(block.vtx[0], SER_DISK, CLIENT_VERSION)));
+    BOOST_REQUIRE(pblocktree->WriteTxIndex(vPos));
+
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.nHeight = 7;
+    index.phashBlock = &mapBlockIndex.emplace(hashBlock, &index).first->first;
+
+    bool fTxIndexOld = fTxIndex;
+    fTxIndex = true;
+
+    // Undo data written while the mint kept the transaction in the UTXO set has no metadata, and the mint
+    // isn't in the view to take it from
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    bool fClean = true;
+    BOOST_CHECK(ApplyTxInUndo(Coin(tx.vout[1], 0, false, false), view, COutPoint(tx.GetHash(), 1), fClean));
+    BOOST_CHECK(fClean);
+    const Coin& coin = view.AccessCoin(COutPoint(tx.GetHash(), 1));
+    BOOST_CHECK(coin.out == tx.vout[1]);
+    BOOST_CHECK(coin.nHeight == 7);
+    BOOST_CHECK(!coin.fCoinBase);
+    BOOST_CHECK(!coin.fCoinStake);
+
+    // A transaction that can't be found can't be restored
+    BOOST_CHECK(!ApplyTxInUndo(Coin(tx.vout[1], 0, false, false), view, COutPoint(GetRandHash(), 1), fClean));
+
+    fTxIndex = fTxIndexOld;
+    mapBlockIndex.erase(hashBlock);
+}
+
+/** A per-transaction UTXO record as written before the chainstate upgrade, with only vout[0] unspent */
+struct LegacyCoinsRecord {
+    CTxOut out;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        int nTxVersion = 1;
+        unsigned int nCode = 4;
+        READWRITE(VARINT(nTxVersion));
+        READWRITE(VARINT(nCode));
+        READWRITE(REF(CTxOutCompressor(REF(out))));
+        READWRITE(VARINT(nHeight));
+    }
+};
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    void WriteLegacy(const uint256& txid, const LegacyCoinsRecord& record)
+    {
+        BOOST_REQUIRE(db.Write(std::make_pair('c', txid), record));
+    }
+};
+
+BOOST_AUTO_TEST_CASE(upgrade_keeps_mint_metadata)
+{
+    // The change of a mint was spent before the upgrade, leaving only the mint in the record
+    LegacyCoinsRecord record;
+    record.out = CTxOut(10 * COIN, CScript() << OP_ZEROCOINMINT << std::vector<unsigned char>(32, 0x01));
+    record.nHeight = 12;
+    uint256 txid = GetRandHash();
+    CCoinsViewDBTest dbview;
+    dbview.WriteLegacy(txid, record);
+    BOOST_CHECK(dbview.Upgrade());
+
+    // The mint isn't kept in the UTXO set, but its height and flags are
+    BOOST_CHECK(!dbview.HaveCoin(COutPoint(txid, 0)));
+    Coin metadata;
+    BOOST_CHECK(dbview.GetTxMetadata(txid, metadata));
+    BOOST_CHECK(metadata.nHeight == 12);
+    BOOST_CHECK(!metadata.fCoinBase);
+    BOOST_CHECK(!metadata.fCoinStake);
+
+    // Disconnecting the block that spent the change restores it without a transaction index
+    bool fTxIndexOld = fTxIndex;
+    fTxIndex = false;
+    CCoinsViewCache view(&dbview);
+    CTxOut change(3 * COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x02) << OP_EQUALVERIFY << OP_CHECKSIG);
+    bool fClean = true;
+    BOOST_CHECK(ApplyTxInUndo(Coin(change, 0, false, false), view, COutPoint(txid, 1), fClean));
+    BOOST_CHECK(fClean);
+    const Coin& coin = view.AccessCoin(COutPoint(txid, 1));
+    BOOST_CHECK(coin.out == change);
+    BOOST_CHECK(coin.nHeight == 12);
+    fTxIndex = fTxIndexOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
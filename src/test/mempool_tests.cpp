@@ -70,6 +70,9 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
         testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
         testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
     }
+    // A transaction already in the pool is refused
+    BOOST_CHECK(!testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1)));
+    BOOST_CHECK_EQUAL(testPool.size(), 7U);
     // Remove Child[0], GrandChild[0] should be removed:
     testPool.remove(txChild[0], removed, true);
     BOOST_CHECK_EQUAL(removed.size(), 2);
@@ -99,4 +102,55 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorStateTest)
+{
+    // A chain of three transactions, each paying a higher fee than its parent
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        if (i > 0)
+            tx[i].vin[0].prevout = COutPoint(tx[i - 1].GetHash(), 0);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 33000LL - i * 1000;
+    }
+    CTxMemPool testPool(CFeeRate(0));
+    LOCK(testPool.cs);
+
+    // Add the child first, its parent arrives later as after a re-org
+    testPool.addUnchecked(tx[1].GetHash(), CTxMemPoolEntry(tx[1], 2000, 0, 0.0, 1));
+    testPool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 3000, 0, 0.0, 1));
+    testPool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 1000, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& entry0 = testPool.mapTx[tx[0].GetHash()];
+    const CTxMemPoolEntry& entry2 = testPool.mapTx[tx[2].GetHash()];
+    uint64_t nTxSize = entry0.GetTxSize();
+    BOOST_CHECK_EQUAL(entry0.GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(entry2.GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(entry2.GetSizeWithAncestors(), 3 * nTxSize);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 6000);
+    BOOST_CHECK(testPool.GetMemPoolParents(tx[1].GetHash()).count(tx[0].GetHash()));
+    BOOST_CHECK(testPool.GetMemPoolChildren(tx[1].GetHash()).count(tx[2].GetHash()));
+
+    // The youngest transaction has the best package
+    BOOST_CHECK_EQUAL(testPool.setAncestorScore.size(), 3);
+    BOOST_CHECK((*testPool.setAncestorScore.begin())->GetTx().GetHash() == tx[2].GetHash());
+
+    // Fee deltas count for the descendants too
+    testPool.PrioritiseTransaction(tx[0].GetHash(), tx[0].GetHash().ToString(), 0, 10000);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 16000);
+    BOOST_CHECK((*testPool.setAncestorScore.begin())->GetTx().GetHash() == tx[0].GetHash());
+
+    // The parent confirmed, the rest no longer counts it
+    std::list<CTransaction> removed;
+    testPool.remove(tx[0], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(entry2.GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(entry2.GetModFeesWithAncestors(), 5000);
+    BOOST_CHECK(testPool.GetMemPoolParents(tx[1].GetHash()).empty());
+    BOOST_CHECK_EQUAL(testPool.setAncestorScore.size(), 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -101,4 +101,54 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(zerocoin_supply_serialization)
+{
+    // The fixed-size supply must stay byte-compatible with the std::map it replaced on disk.
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+    CZerocoinSupply supply;
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        int64_t nSupply = insecure_rand();
+        mapSupply[denom] = nSupply;
+        supply.at(denom) = nSupply;
+    }
+
+    CDataStream ssMap(SER_DISK, CLIENT_VERSION);
+    ssMap << mapSupply;
+    CDataStream ssSupply(SER_DISK, CLIENT_VERSION);
+    ssSupply << supply;
+    BOOST_CHECK(ssMap.str() == ssSupply.str());
+    BOOST_CHECK_EQUAL(supply.GetSerializeSize(SER_DISK, CLIENT_VERSION), ssSupply.size());
+
+    CZerocoinSupply supply2;
+    ssMap >> supply2;
+    BOOST_CHECK(supply == supply2);
+    BOOST_CHECK_THROW(supply2.at(libzerocoin::ZQ_ERROR), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_arena)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 10000; i++) {
+        vIndex.push_back(arena.Create());
+        vIndex.back()->nHeight = i;
+        vIndex.back()->cold->zerocoinSupply.at(libzerocoin::ZQ_ONE) = i;
+    }
+    BOOST_CHECK_EQUAL(arena.size(), vIndex.size());
+    // The cold data comes from the arena too, laid out like the entries
+    BOOST_CHECK(&*vIndex[1]->cold == &*vIndex[0]->cold + 1);
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, i);
+        BOOST_CHECK_EQUAL(vIndex[i]->GetZcMints(libzerocoin::ZQ_ONE), i);
+    }
+
+    // Copies, such as the CDiskBlockIndex written to disk, own their cold data.
+    CBlockIndex copy(*vIndex[5]);
+    copy.cold->zerocoinSupply.at(libzerocoin::ZQ_ONE) = 42;
+    BOOST_CHECK_EQUAL(vIndex[5]->GetZcMints(libzerocoin::ZQ_ONE), 5);
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
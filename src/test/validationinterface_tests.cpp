@@ -0,0 +1,129 @@
+// Copyright (c) 2018-2019 The WISPR developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "test_wispr.h"
+#include "validationinterface.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+namespace {
+/** Records the notifications it gets and the thread they arrive on */
+class CRecordingInterface : public CValidationInterface
+{
+public:
+    std::vector<int> vEvents;
+    std::vector<boost::thread::id> vThreads;
+    int nSlowMillis = 0;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex) override
+    {
+        Record(pindex->nHeight);
+    }
+
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override
+    {
+        // The block is still readable however late the notification is handled
+        if (pblock)
+            BOOST_CHECK(pblock->vtx.size() == 1 && pblock->vtx[0] == tx);
+        Record(-(int)tx.nLockTime);
+    }
+
+    void SetBestChain(const CBlockLocator& locator) override
+    {
+        Record(1000 * locator.vHave.size());
+    }
+
+private:
+    void Record(int nEvent)
+    {
+        if (nSlowMillis)
+            MilliSleep(nSlowMillis);
+        vEvents.push_back(nEvent);
+        vThreads.push_back(boost::this_thread::get_id());
+    }
+};
+
+CTransaction MakeTx(uint32_t nLockTime)
+{
+    CMutableTransaction tx;
+    tx.nLockTime = nLockTime;
+    return tx;
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(validationinterface_inline)
+{
+    CRecordingInterface listener;
+    RegisterValidationInterface(&listener);
+
+    CBlockIndex index;
+    index.nHeight = 7;
+    GetMainSignals().UpdatedBlockTip(&index);
+    SyncWithWallets(MakeTx(3), nullptr);
+
+    // Without a started queue everything is handled before the call returns
+    BOOST_CHECK(listener.vEvents == std::vector<int>({7, -3}));
+    BOOST_CHECK(listener.vThreads[0] == boost::this_thread::get_id());
+    UnregisterValidationInterface(&listener);
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_queue)
+{
+    CRecordingInterface listener;
+    listener.nSlowMillis = 1;
+    RegisterValidationInterface(&listener);
+    StartValidationInterfaceQueue();
+
+    std::vector<CBlockIndex> vIndex(20);
+    std::vector<int> vExpected;
+    for (int i = 0; i < 20; i++) {
+        vIndex[i].nHeight = i + 1;
+        CBlock block;
+        block.vtx.push_back(MakeTx(i + 1));
+        {
+            // The block goes out of scope long before the listener gets to it
+            std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+            SyncWithWallets(block.vtx[0], pblock);
+        }
+        GetMainSignals().UpdatedBlockTip(&vIndex[i]);
+        vExpected.push_back(-(i + 1));
+        vExpected.push_back(i + 1);
+    }
+    // The locator is written only after the transactions before it were handled
+    GetMainSignals().SetBestChain(CBlockLocator(std::vector<uint256>(2)));
+    vExpected.push_back(2000);
+
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(listener.vEvents == vExpected);
+    for (const boost::thread::id& id : listener.vThreads)
+        BOOST_CHECK(id != boost::this_thread::get_id());
+
+    // A listener registered while the queue runs gets its own thread too
+    CRecordingInterface late;
+    RegisterValidationInterface(&late);
+    SyncWithWallets(MakeTx(100), nullptr);
+    LimitValidationInterfaceQueue();
+    UnregisterValidationInterface(&late);
+    BOOST_CHECK(late.vEvents == std::vector<int>({-100}));
+    BOOST_CHECK(late.vThreads[0] != boost::this_thread::get_id());
+
+    // Stopping delivers what is left, then delivery is inline again
+    SyncWithWallets(MakeTx(200), nullptr);
+    StopValidationInterfaceQueue();
+    BOOST_CHECK(listener.vEvents.back() == -200);
+    SyncWithWallets(MakeTx(300), nullptr);
+    BOOST_CHECK(listener.vEvents.back() == -300);
+    BOOST_CHECK(listener.vThreads.back() == boost::this_thread::get_id());
+
+    UnregisterValidationInterface(&listener);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
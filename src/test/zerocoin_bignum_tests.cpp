@@ -87,4 +87,52 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_multi_pow_mod_tests)
+{
+    CBigNum m;
+    m.SetHex(strHexModulus);
+
+    for (int k = 1; k <= 5; k++) {
+        std::vector<std::pair<CBigNum, CBigNum> > terms;
+        CBigNum expected = 1;
+        for (int i = 0; i < k; i++) {
+            CBigNum base = CBigNum::randBignum(m);
+            while (base.gcd(m) != 1)
+                base = CBigNum::randBignum(m);
+            // mix exponent sizes, zero and negative exponents
+            CBigNum exp = CBigNum::randKBitBignum(1 + (k * 577 + i * 911) % 3000);
+            if (i == 1)
+                exp = 0;
+            if (i % 2 == 0 && k % 2 == 0)
+                exp = -exp;
+            terms.emplace_back(base, exp);
+            expected = expected.mul_mod(base.pow_mod(exp, m), m);
+        }
+        BOOST_CHECK_MESSAGE(CBigNum::multi_pow_mod(terms, m) == expected,
+                strprintf("CBigNum::multi_pow_mod() does not match pow_mod() product for %d terms", k));
+    }
+
+    BOOST_CHECK(CBigNum::multi_pow_mod({}, m) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(bignum_fixed_base_tests)
+{
+    CBigNum m;
+    m.SetHex(strHexModulus);
+    CBigNum base = CBigNum::randBignum(m);
+    while (base.gcd(m) != 1)
+        base = CBigNum::randBignum(m);
+    CBigNumFixedBase table(base, m, 1024);
+
+    BOOST_CHECK(table.pow_mod(CBigNum(0)) == 1);
+    // inside the table range, negative, and past the table range (pow_mod fallback)
+    for (int bits : {1, 7, 256, 1023, 1024, 1025, 3000}) {
+        CBigNum exp = CBigNum::randKBitBignum(bits);
+        BOOST_CHECK_MESSAGE(table.pow_mod(exp) == base.pow_mod(exp, m),
+                strprintf("CBigNumFixedBase::pow_mod() failed for a %d bit exponent", bits));
+        BOOST_CHECK_MESSAGE(table.pow_mod(-exp) == base.pow_mod(-exp, m),
+                strprintf("CBigNumFixedBase::pow_mod() failed for a negative %d bit exponent", bits));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
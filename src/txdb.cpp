@@ -6,48 +6,139 @@
 
 #include "txdb.h"
 
+#include "guiinterface.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
 #include "zpiv/accumulators.h"
 
 #include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
 
 #include <boost/thread.hpp>
 
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+static const char DB_COIN = 'C';
+static const char DB_COINS = 'c';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_TX_METADATA = 'm';
+
+namespace
 {
-    if (coins.IsPruned()){
-        batch.Erase(std::make_pair('c', hash));
-    }else{
-        batch.Write(std::make_pair('c', hash), coins);
+/** Key of a per-outpoint chainstate record: 'C', txid, VARINT(n), so the outputs of a transaction are adjacent */
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    explicit CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(key);
+        READWRITE(outpoint->hash);
+        READWRITE(VARINT(outpoint->n));
+    }
+};
+
+/**
+ * Legacy per-transaction chainstate record, only read to upgrade the database.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode)
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ *
+ * The nCode value consists of:
+ * - bit 1: IsCoinBase()
+ * - bit 2: IsCoinStake()
+ * - bit 4: vout[0] is not spent
+ * - bit 8: vout[1] is not spent
+ * - The higher bits encode N, the number of non-zero bytes in the following bitvector.
+ *   - In case both bit 4 and bit 8 are unset, they encode N-1, as there must be at
+ *     least one non-spent output).
+ */
+class CCoins
+{
+public:
+    bool fCoinBase;
+    bool fCoinStake;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CCoins() : fCoinBase(false), fCoinStake(false), nHeight(0) {}
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned int nCode = 0;
+        int nTxVersion = 0;
+        ::Unserialize(s, VARINT(nTxVersion), nType, nVersion);
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        fCoinBase = nCode & 1;
+        fCoinStake = (nCode & 2) != 0;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 4) != 0;
+        vAvail[1] = (nCode & 8) != 0;
+        unsigned int nMaskCode = (nCode / 16) + ((nCode & 12) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail, nType, nVersion);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
+        }
+        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
     }
+};
 }
 
-void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
-    batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewDB::GetTxMetadata(const uint256& txid, Coin& coin) const
 {
-    return db.Read(std::make_pair('c', txid), coins);
+    uint32_t nCode;
+    if (!db.Read(std::make_pair(DB_TX_METADATA, txid), nCode))
+        return false;
+    coin.nHeight = nCode >> 2;
+    coin.fCoinBase = (nCode >> 1) & 1;
+    coin.fCoinStake = nCode & 1;
+    return true;
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256& txid) const
+bool CCoinsViewDB::HaveCoin(const COutPoint& outpoint) const
 {
-    return db.Exists(std::make_pair('c', txid));
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain)){
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain)){
         return {0};
     }
     return hashBestChain;
@@ -60,7 +151,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
@@ -68,10 +163,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
         mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0)){
-        BatchWriteHashBestChain(batch, hashBlock);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
     }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", static_cast<unsigned int>(changed), static_cast<unsigned int>(count));
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", static_cast<unsigned int>(changed), static_cast<unsigned int>(count));
     return db.WriteBatch(batch);
 }
 
@@ -108,60 +203,158 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+static void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    const Coin& first = outputs.begin()->second;
+    ss << VARINT(first.nHeight * 4 + first.fCoinBase * 2 + first.fCoinStake);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out;
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    pcursor->Seek(std::string(1, DB_COIN));
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
+            if (slKey.empty() || slKey[0] != DB_COIN)
+                break;
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            COutPoint outpoint;
+            CoinEntry entry(&outpoint);
+            ssKey >> entry;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            Coin coin;
+            ssValue >> coin;
+            if (!outputs.empty() && outpoint.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
+            prevkey = outpoint.hash;
+            outputs[outpoint.n] = std::move(coin);
+            stats.nSerializedSize += slKey.size() + slValue.size();
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (!outputs.empty())
+        ApplyStats(stats, ss, prevkey, outputs);
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
+/** Upgrade the database from older formats.
+ *
+ * Currently implemented: from one record per transaction to one record per unspent output.
+ */
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::string(1, DB_COINS));
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COINS)
+        return true;
+
+    int64_t count = 0;
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CLevelDBBatch batch;
+    int reportDone = 0;
+    std::pair<char, uint256> key;
+    std::pair<char, uint256> prev_key = std::make_pair(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        try {
+            ssKey >> key;
+        } catch (const std::exception&) {
+            break;
+        }
+        if (key.first != DB_COINS)
+            break;
+        if (count++ % 256 == 0) {
+            uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+            int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+            uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+            if (reportDone < percentageDone / 10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone / 10;
+            }
+        }
+        CCoins old_coins;
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> old_coins;
+        } catch (const std::exception& e) {
+            return error("%s: cannot parse CCoins record: %s", __func__, e.what());
+        }
+        COutPoint outpoint(key.second, 0);
+        bool fDropped = false;
+        for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+            if (old_coins.vout[i].IsNull())
+                continue;
+            if (!IsUTXOOutput(old_coins.vout[i])) {
+                fDropped = true;
+                continue;
+            }
+            Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase, old_coins.fCoinStake);
+            outpoint.n = i;
+            CoinEntry entry(&outpoint);
+            batch.Write(entry, newcoin);
+        }
+        if (fDropped) {
+            // Undo records of the transaction's other outputs left the metadata out, as this one was still unspent
+            uint32_t nCode = old_coins.nHeight * 4 + old_coins.fCoinBase * 2 + old_coins.fCoinStake;
+            batch.Write(std::make_pair(DB_TX_METADATA, key.second), nCode);
+        }
+        batch.Erase(key);
+        // Each batch converts a run of records and erases them atomically, so an
+        // interrupted upgrade continues where it stopped on the next start.
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch))
+                return error("%s: failed to write upgraded UTXO records", __func__);
+            batch.Clear();
+            db.CompactRange(prev_key, key);
+            prev_key = key;
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s: failed to write upgraded UTXO records", __func__);
+    db.CompactRange(std::make_pair(DB_COINS, uint256()), key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CLevelDBBatch batch;
     for (const auto & it : fileInfo) {
@@ -213,31 +406,179 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
-{
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+namespace
+{
+/**
+ * Hands decoded block index records from the threads reading disjoint key
+ * ranges of the block tree to the single thread that links them into
+ * mapBlockIndex. Only a bounded number of batches is kept in flight.
+ */
+class CBlockIndexLoadQueue
+{
+public:
+    typedef std::vector<std::pair<uint256, CDiskBlockIndex> > Batch;
+
+private:
+    static const size_t MAX_PENDING_BATCHES = 16;
+
+    boost::mutex mutex;
+    boost::condition_variable condProduced;
+    boost::condition_variable condConsumed;
+    std::deque<Batch> queue;
+    unsigned int nProducers;
+    bool fAbort;
+    std::string strError;
+
+public:
+    explicit CBlockIndexLoadQueue(unsigned int nProducersIn) : nProducers(nProducersIn), fAbort(false) {}
+
+    //! Queue a batch, waiting while the linking thread is behind. Returns false once loading was aborted.
+    bool Push(Batch&& batch)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fAbort && queue.size() >= MAX_PENDING_BATCHES)
+            condConsumed.wait(lock);
+        if (fAbort)
+            return false;
+        queue.push_back(std::move(batch));
+        condProduced.notify_one();
+        return true;
+    }
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << std::make_pair('b', uint256(0));
-    pcursor->Seek(ssKeySet.str());
+    //! Take the next batch. Returns false when every reader is done and nothing is left, or on failure.
+    bool Pop(Batch& batch)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fAbort && queue.empty() && nProducers > 0)
+            condProduced.wait(lock);
+        if (fAbort || queue.empty())
+            return false;
+        batch = std::move(queue.front());
+        queue.pop_front();
+        condConsumed.notify_one();
+        return true;
+    }
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+    //! Called once by every reader when it stops; a non-empty error aborts the whole load.
+    void Done(const std::string& strErrorIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nProducers--;
+        if (!strErrorIn.empty() && strError.empty()) {
+            strError = strErrorIn;
+            fAbort = true;
+            condConsumed.notify_all();
+        }
+        condProduced.notify_all();
+    }
+
+    void Abort()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fAbort = true;
+        condConsumed.notify_all();
+        condProduced.notify_all();
+    }
+
+    std::string GetError()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return strError;
+    }
+};
+
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1024;
+
+/**
+ * Deserialize the 'b' records whose block hash starts with a byte in
+ * [nBegin, nEnd). Hashing the header and checking proof of work is the
+ * expensive part of loading the index, so it is done here rather than on
+ * the linking thread.
+ */
+void ReadBlockIndexRange(CBlockTreeDB& db, unsigned int nBegin, unsigned int nEnd, CBlockIndexLoadQueue& queue)
+{
+    std::string strError;
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+
+        uint256 hashBegin;
+        *hashBegin.begin() = nBegin;
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << std::make_pair('b', hashBegin);
+        pcursor->Seek(ssKeySet.str());
+
+        CBlockIndexLoadQueue::Batch batch;
+        batch.reserve(BLOCK_INDEX_LOAD_BATCH);
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
             leveldb::Slice slKey = pcursor->key();
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
+            uint256 hashKey;
             ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
+            if (chType != 'b')
+                break;
+            ssKey >> hashKey;
+            if (*hashKey.begin() >= nEnd)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            uint256 hash = diskindex.GetBlockHash();
+            if (diskindex.IsProofOfWork() && !CheckProofOfWork(diskindex.GetProofOfWorkHash(), diskindex.nBits)) {
+                strError = strprintf("CheckProofOfWork failed: %s", hash.ToString());
+                break;
+            }
+
+            batch.emplace_back(hash, std::move(diskindex));
+            if (batch.size() == BLOCK_INDEX_LOAD_BATCH) {
+                if (!queue.Push(std::move(batch)))
+                    break;
+                batch = CBlockIndexLoadQueue::Batch();
+                batch.reserve(BLOCK_INDEX_LOAD_BATCH);
+            }
+        }
+        if (strError.empty() && !batch.empty())
+            queue.Push(std::move(batch));
+    } catch (const boost::thread_interrupted&) {
+        strError = "interrupted";
+    } catch (const std::exception& e) {
+        strError = strprintf("Deserialize or I/O error - %s", e.what());
+    }
+    queue.Done(strError);
+}
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    // Block hashes are uniformly distributed, so splitting the 'b' records on
+    // the first byte of the hash gives every reader a similar share.
+    unsigned int nThreads = std::max(1u, std::min(boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    CBlockIndexLoadQueue queue(nThreads);
+    boost::thread_group threadGroup;
+    for (unsigned int t = 0; t < nThreads; t++) {
+        unsigned int nBegin = t * 256 / nThreads;
+        unsigned int nEnd = (t + 1) * 256 / nThreads;
+        threadGroup.create_thread([this, nBegin, nEnd, &queue]() {
+            RenameThread("wispr-loadidx");
+            ReadBlockIndexRange(*this, nBegin, nEnd, queue);
+        });
+    }
+
+    // Link mapBlockIndex on this thread while the readers keep decoding
+    std::set<uint256> setCheckpointsLoaded;
+    try {
+        CBlockIndexLoadQueue::Batch batch;
+        while (queue.Pop(batch)) {
+            boost::this_thread::interruption_point();
+            for (std::pair<uint256, CDiskBlockIndex>& entry : batch) {
+                CDiskBlockIndex& diskindex = entry.second;
 
                 // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = InsertBlockIndex(entry.first);
                 pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
                 pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
                 pindexNew->nHeight = diskindex.nHeight;
@@ -254,42 +595,35 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
                 //zerocoin
                 pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
 
                 //Proof Of Stake
                 pindexNew->nMint = diskindex.nMint;
                 pindexNew->nMoneySupply = diskindex.nMoneySupply;
                 pindexNew->nFlags = diskindex.nFlags;
                 pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->bnStakeModifierV2 = diskindex.bnStakeModifierV2;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->IsProofOfWork()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHeader().GetPoWHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zwsp. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT()){
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-                    }
+                //stake and zerocoin fields kept out of line
+                *pindexNew->cold = std::move(*diskindex.cold);
 
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
+                //populate accumulator checksum map in memory, once per distinct checkpoint
+                //Don't load any checkpoints that exist before v2 zwsp. The accumulator is invalid for v1 and not used.
+                if (pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT() &&
+                    setCheckpointsLoaded.insert(pindexNew->nAccumulatorCheckpoint).second) {
+                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
                 }
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+    } catch (...) {
+        queue.Abort();
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        throw;
     }
+    threadGroup.join_all();
+
+    std::string strError = queue.GetError();
+    if (!strError.empty())
+        return error("LoadBlockIndex() : %s", strError);
 
     return true;
 }
@@ -298,9 +632,21 @@ CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB
 {
 }
 
-bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
+static std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > BlockPubcoinsEntry(const std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > vPubcoins;
+    vPubcoins.reserve(listPubcoins.size());
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        vPubcoins.emplace_back(pubcoin.getDenomination(), pubcoin.getValue());
+    return vPubcoins;
+}
+
+bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo, const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listBlockPubcoins)
 {
     CLevelDBBatch batch;
+    // Only blocks with mints get a pubcoin index entry
+    if (!listBlockPubcoins.empty())
+        batch.Write(std::make_pair('p', hashBlock), BlockPubcoinsEntry(listBlockPubcoins));
     size_t count = 0;
     for (const auto & it : mintInfo) {
         libzerocoin::PublicCoin pubCoin = it.first;
@@ -329,6 +675,21 @@ bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
     return Erase(std::make_pair('m', hash));
 }
 
+bool CZerocoinDB::WriteBlockPubcoins(const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    return Write(std::make_pair('p', hashBlock), BlockPubcoinsEntry(listPubcoins));
+}
+
+bool CZerocoinDB::ReadBlockPubcoins(const uint256& hashBlock, std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> >& vPubcoins)
+{
+    return Read(std::make_pair('p', hashBlock), vPubcoins);
+}
+
+bool CZerocoinDB::EraseBlockPubcoins(const uint256& hashBlock)
+{
+    return Erase(std::make_pair('p', hashBlock));
+}
+
 bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo)
 {
     CLevelDBBatch batch;
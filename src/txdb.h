@@ -11,12 +11,12 @@
 #include "main.h"
 #include "zpiv/zerocoin.h"
 
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
-class CCoins;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -25,6 +25,8 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! max number of threads reading the block index at startup
+static const unsigned int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -35,11 +37,19 @@ protected:
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
     uint256 GetBestBlock() const;
+    bool GetTxMetadata(const uint256& txid, Coin& coin) const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    /**
+     * Convert an older per-transaction database in place. Returns false if that failed or shutdown
+     * interrupted it. Transactions with outputs that are not kept, such as zerocoin mints, leave
+     * their metadata behind, as undo data written before the upgrade may rely on them.
+     */
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -65,6 +75,11 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    /**
+     * Load every block index record into mapBlockIndex. Records are read and
+     * hashed by up to MAX_BLOCK_INDEX_LOAD_THREADS threads, each covering a
+     * slice of the key space, and linked on the calling thread as they arrive.
+     */
     bool LoadBlockIndexGuts();
 };
 
@@ -80,7 +95,7 @@ private:
 
 public:
     /** Write zWSP mints to the zerocoinDB in a batch */
-    bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo);
+    bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo, const uint256& hashBlock = uint256(), const std::list<libzerocoin::PublicCoin>& listBlockPubcoins = std::list<libzerocoin::PublicCoin>());
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
     bool ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx);
     /** Write zWSP spends to the zerocoinDB in a batch */
@@ -89,6 +104,10 @@ public:
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
+    /** Per-block index of the (filtered) zWSP mints, so accumulation doesn't need to read full blocks */
+    bool WriteBlockPubcoins(const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool ReadBlockPubcoins(const uint256& hashBlock, std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> >& vPubcoins);
+    bool EraseBlockPubcoins(const uint256& hashBlock);
     bool WipeCoins(const std::string& strType);
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
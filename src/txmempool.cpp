@@ -17,16 +17,24 @@
 #include <random>
 
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0), nSigOps(0),
+                                     nCountWithAncestors(0), nSizeWithAncestors(0), nModFeesWithAncestors(0), nSigOpsWithAncestors(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nSigOps = GetLegacySigOpCount(tx);
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nSigOpsWithAncestors = nSigOps;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -376,17 +384,10 @@ CTxMemPool::~CTxMemPool()
     delete minerPolicyEstimator;
 }
 
-void CTxMemPool::pruneSpent(const uint256& hashTx, CCoins& coins)
+bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
-
-    auto it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first.hash == hashTx) {
-        coins.Spend(it->first.n); // and remove those outputs from coins
-        it++;
-    }
+    return mapNextTx.count(outpoint);
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -409,24 +410,122 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        // Adding it again would count it twice in the package state of its relatives
+        if (mapTx.count(hash))
+            return false;
+
+        CTxMemPoolEntry& newEntry = mapTx[hash];
+        newEntry = entry;
+        const CTransaction& tx = newEntry.GetTx();
+        TxLinks& links = mapLinks[hash];
         if(!tx.HasZerocoinSpendInputs()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+                const uint256& hashParent = tx.vin[i].prevout.hash;
+                if (mapTx.count(hashParent)) {
+                    links.parents.insert(hashParent);
+                    mapLinks[hashParent].children.insert(hash);
+                }
+            }
         }
+        // After a reorg, spends of this transaction can already be in the pool
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto it = mapNextTx.find(COutPoint(hash, i));
+            if (it == mapNextTx.end())
+                continue;
+            const uint256& hashChild = it->second.ptx->GetHash();
+            links.children.insert(hashChild);
+            mapLinks[hashChild].parents.insert(hash);
+        }
+
+        auto pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            newEntry.nFeeDelta = pos->second.second;
+
+        UpdateAncestorState(hash);
+        std::set<uint256> setDescendants;
+        CalculateDescendants(hash, setDescendants);
+        for (const uint256& hashDescendant : setDescendants)
+            UpdateAncestorState(hashDescendant);
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
     return true;
 }
 
+void CTxMemPool::UpdateAncestorState(const uint256& hash)
+{
+    auto it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return;
+    CTxMemPoolEntry& entry = it->second;
+
+    std::set<uint256> setAncestors;
+    CalculateAncestors(hash, setAncestors);
+
+    setAncestorScore.erase(&entry);
+    entry.nCountWithAncestors = 1;
+    entry.nSizeWithAncestors = entry.GetTxSize();
+    entry.nModFeesWithAncestors = entry.GetModifiedFee();
+    entry.nSigOpsWithAncestors = entry.GetSigOpCount();
+    for (const uint256& hashAncestor : setAncestors) {
+        const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+        entry.nCountWithAncestors++;
+        entry.nSizeWithAncestors += ancestor.GetTxSize();
+        entry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+        entry.nSigOpsWithAncestors += ancestor.GetSigOpCount();
+    }
+    setAncestorScore.insert(&entry);
+}
+
+const std::set<uint256>& CTxMemPool::GetMemPoolParents(const uint256& hash) const
+{
+    static const std::set<uint256> setEmpty;
+    auto it = mapLinks.find(hash);
+    return it == mapLinks.end() ? setEmpty : it->second.parents;
+}
+
+const std::set<uint256>& CTxMemPool::GetMemPoolChildren(const uint256& hash) const
+{
+    static const std::set<uint256> setEmpty;
+    auto it = mapLinks.find(hash);
+    return it == mapLinks.end() ? setEmpty : it->second.children;
+}
+
+void CTxMemPool::CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const
+{
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        for (const uint256& hashParent : GetMemPoolParents(hashVisit)) {
+            if (setAncestors.insert(hashParent).second)
+                vToVisit.push_back(hashParent);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        uint256 hashVisit = vToVisit.back();
+        vToVisit.pop_back();
+        for (const uint256& hashChild : GetMemPoolChildren(hashVisit)) {
+            if (setDescendants.insert(hashChild).second)
+                vToVisit.push_back(hashChild);
+        }
+    }
+}
+
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
+        std::set<uint256> setUpdate; // remaining children of removed transactions
         std::deque<uint256> txToRemove;
         txToRemove.push_back(origTx.GetHash());
         if (fRecursive && !mapTx.count(origTx.GetHash())) {
@@ -458,11 +557,33 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
             for (const CTxIn& txin : tx.vin)
                 mapNextTx.erase(txin.prevout);
 
+            auto itLinks = mapLinks.find(hash);
+            if (itLinks != mapLinks.end()) {
+                for (const uint256& hashParent : itLinks->second.parents)
+                    mapLinks[hashParent].children.erase(hash);
+                for (const uint256& hashChild : itLinks->second.children) {
+                    mapLinks[hashChild].parents.erase(hash);
+                    setUpdate.insert(hashChild);
+                }
+                mapLinks.erase(itLinks);
+            }
+            setUpdate.erase(hash);
+            setAncestorScore.erase(&mapTx[hash]);
+
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
             mapTx.erase(hash);
             nTransactionsUpdated++;
         }
+
+        // Whatever descends from a removed transaction lost ancestors
+        std::set<uint256> setDescendants;
+        for (const uint256& hash : setUpdate) {
+            setDescendants.insert(hash);
+            CalculateDescendants(hash, setDescendants);
+        }
+        for (const uint256& hash : setDescendants)
+            UpdateAncestorState(hash);
     }
 }
 
@@ -477,9 +598,9 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
             std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
-            const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-            if (fSanityCheck) assert(coins);
-            if (!coins || ((coins->IsCoinBase() || coins->IsCoinStake()) && nMemPoolHeight - coins->nHeight < (unsigned)Params().COINBASE_MATURITY())) {
+            const Coin& coin = pcoins->AccessCoin(txin.prevout);
+            if (fSanityCheck) assert(!coin.IsSpent());
+            if (coin.IsSpent() || ((coin.IsCoinBase() || coin.IsCoinStake()) && nMemPoolHeight - coin.nHeight < (unsigned)Params().COINBASE_MATURITY())) {
                 transactionsToRemove.push_back(tx);
                 break;
             }
@@ -534,6 +655,8 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapLinks.clear();
+    setAncestorScore.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -564,9 +687,8 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
             } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 if(!txin.IsZerocoinSpend() && !txin.IsZerocoinPublicSpend())
-                    assert(coins && coins->IsAvailable(txin.prevout.n));
+                    assert(pcoins->HaveCoin(txin.prevout));
             }
             // Check whether its inputs are marked in mapNextTx.
             if(!txin.IsZerocoinSpend()  && !txin.IsZerocoinPublicSpend()) {
@@ -579,6 +701,34 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             }
             i++;
         }
+        // Check the links to in-mempool parents and the ancestor totals
+        std::set<uint256> setParentCheck;
+        if (!tx.HasZerocoinSpendInputs()) {
+            for (const CTxIn& txin : tx.vin) {
+                if (mapTx.count(txin.prevout.hash))
+                    setParentCheck.insert(txin.prevout.hash);
+            }
+        }
+        assert(setParentCheck == GetMemPoolParents(it->first));
+        for (const uint256& hashParent : setParentCheck)
+            assert(GetMemPoolChildren(hashParent).count(it->first));
+        std::set<uint256> setAncestors;
+        CalculateAncestors(it->first, setAncestors);
+        uint64_t nSizeCheck = it->second.GetTxSize();
+        CAmount nFeesCheck = it->second.GetModifiedFee();
+        unsigned int nSigOpsCheck = it->second.GetSigOpCount();
+        for (const uint256& hashAncestor : setAncestors) {
+            const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+            nSizeCheck += ancestor.GetTxSize();
+            nFeesCheck += ancestor.GetModifiedFee();
+            nSigOpsCheck += ancestor.GetSigOpCount();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeCheck);
+        assert(it->second.GetModFeesWithAncestors() == nFeesCheck);
+        assert(it->second.GetSigOpsWithAncestors() == nSigOpsCheck);
+        assert(setAncestorScore.count(&it->second));
+
         if (fDependsWait)
             waitingOnDependants.push_back(&it->second);
         else {
@@ -615,6 +765,8 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+    assert(mapLinks.size() == mapTx.size());
+    assert(setAncestorScore.size() == mapTx.size());
 }
 
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
@@ -695,6 +847,16 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const std::string& s
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        auto it = mapTx.find(hash);
+        if (it != mapTx.end() && nFeeDelta != 0) {
+            it->second.nFeeDelta = deltas.second;
+            std::set<uint256> setUpdate;
+            CalculateDescendants(hash, setUpdate);
+            setUpdate.insert(hash);
+            for (const uint256& hashUpdate : setUpdate)
+                UpdateAncestorState(hashUpdate);
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -720,20 +882,24 @@ void CTxMemPool::ClearPrioritisation(const uint256& hash)
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
-bool CCoinsViewMemPool::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewMemPool::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
     CTransaction tx;
-    if (mempool.lookup(txid, tx)) {
-        coins = CCoins(tx, MEMPOOL_HEIGHT);
-        return true;
+    if (mempool.lookup(outpoint.hash, tx)) {
+        if (outpoint.n < tx.vout.size() && IsUTXOOutput(tx.vout[outpoint.n])) {
+            coin = Coin(tx.vout[outpoint.n], MEMPOOL_HEIGHT, tx.IsCoinBase(), tx.IsCoinStake());
+            return true;
+        }
+        return false;
     }
-    return (base->GetCoins(txid, coins) && !coins.IsPruned());
+    return base->GetCoin(outpoint, coin);
 }
 
-bool CCoinsViewMemPool::HaveCoins(const uint256& txid) const
+bool CCoinsViewMemPool::HaveCoin(const COutPoint& outpoint) const
 {
-    return mempool.exists(txid) || base->HaveCoins(txid);
+    Coin coin;
+    return GetCoin(outpoint, coin);
 }
@@ -8,6 +8,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -29,8 +30,8 @@ inline bool AllowFree(double dPriority)
 }
 
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
-static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Fake height value used in Coin to signify they are only in the memory pool (the largest that fits Coin::nHeight) */
+static const unsigned int MEMPOOL_HEIGHT = 0x3FFFFFFF;
 
 /**
  * CTxMemPool stores these:
@@ -45,6 +46,16 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee delta set with PrioritiseTransaction
+    unsigned int nSigOps; //! Legacy sigop count
+
+    // Totals over this transaction and all its ancestors in the mempool, kept up to date by CTxMemPool
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpsWithAncestors;
+
+    friend class CTxMemPool;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -57,6 +68,27 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+    unsigned int GetSigOpCount() const { return nSigOps; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    unsigned int GetSigOpsWithAncestors() const { return nSigOpsWithAncestors; }
+};
+
+/** Sort entries by the fee rate of their ancestor package, highest first */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        double f1 = (double)a->GetModFeesWithAncestors() * b->GetSizeWithAncestors();
+        double f2 = (double)b->GetModFeesWithAncestors() * a->GetSizeWithAncestors();
+        if (f1 == f2)
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        return f1 > f2;
+    }
 };
 
 class CMinerPolicyEstimator;
@@ -102,11 +134,23 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    struct TxLinks {
+        std::set<uint256> parents;
+        std::set<uint256> children;
+    };
+    //! In-mempool parents and children of every transaction in mapTx
+    std::map<uint256, TxLinks> mapLinks;
+
+    /** Recompute the ancestor totals of a transaction and move it in setAncestorScore */
+    void UpdateAncestorState(const uint256& hash);
+
 public:
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    //! Every entry of mapTx by ancestor package fee rate, for block assembly
+    std::set<const CTxMemPoolEntry*, CompareTxMemPoolEntryByAncestorFee> setAncestorScore;
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -128,7 +172,14 @@ public:
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void getTransactions(std::set<uint256>& setTxid);
-    void pruneSpent(const uint256& hash, CCoins& coins);
+    bool isSpent(const COutPoint& outpoint);
+
+    /** In-mempool parents and children of a transaction in the mempool, cs must be held */
+    const std::set<uint256>& GetMemPoolParents(const uint256& hash) const;
+    const std::set<uint256>& GetMemPoolChildren(const uint256& hash) const;
+    /** Add every in-mempool ancestor (or descendant) of a transaction in the mempool to the set, cs must be held */
+    void CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
@@ -178,8 +229,8 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn);
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
 };
 
 #endif // BITCOIN_TXMEMPOOL_H
@@ -355,7 +355,7 @@ static void inline HashFinal(uint32_t& a, uint32_t& b, uint32_t& c)
     c -= ((b << 24) | (b >> 8));
 }
 
-uint64_t uint256::GetHash(const uint256& salt) const
+uint64_t uint256::GetHash(const uint256& salt, uint32_t nExtra) const
 {
     uint32_t a, b, c;
     a = b = c = 0xdeadbeef + (WIDTH << 2);
@@ -370,6 +370,7 @@ uint64_t uint256::GetHash(const uint256& salt) const
     HashMix(a, b, c);
     a += pn[6] ^ salt.pn[6];
     b += pn[7] ^ salt.pn[7];
+    c += nExtra;
     HashFinal(a, b, c);
 
     return ((((uint64_t)b) << 32) | c);
@@ -359,7 +359,7 @@ public:
      */
     uint256& SetCompact(uint32_t nCompact, bool* pfNegative = nullptr, bool* pfOverflow = nullptr);
     uint32_t GetCompact(bool fNegative = false) const;
-    uint64_t GetHash(const uint256& salt) const;
+    uint64_t GetHash(const uint256& salt, uint32_t nExtra = 0) const;
 };
 
 /* uint256 from const char *.
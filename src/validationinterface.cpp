@@ -6,8 +6,135 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+#include "util.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
 
+namespace {
+/**
+ * Notifications for one listener, in the order they were fired. Once started
+ * a dedicated thread delivers them; otherwise they run inline on the caller.
+ */
+class CValidationQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    std::deque<std::function<void()> > queue;
+    bool fRunning;
+    bool fStopping;
+    //! A notification taken off the queue is still being handled
+    bool fBusy;
+    boost::thread thread;
+
+    void Thread()
+    {
+        RenameThread("wispr-notify");
+        while (true) {
+            std::function<void()> func;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queue.empty() && !fStopping)
+                    condWork.wait(lock);
+                if (queue.empty()) {
+                    // Anything dispatched from now on is delivered inline
+                    fRunning = false;
+                    break;
+                }
+                func = std::move(queue.front());
+                queue.pop_front();
+                fBusy = true;
+            }
+            try {
+                func();
+            } catch (std::exception& e) {
+                PrintExceptionContinue(&e, "wispr-notify");
+            } catch (...) {
+                PrintExceptionContinue(nullptr, "wispr-notify");
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                fBusy = false;
+            }
+            condDone.notify_all();
+        }
+        condDone.notify_all();
+    }
+
+    bool IsQueueThread() const { return boost::this_thread::get_id() == thread.get_id(); }
+
+public:
+    CValidationQueue() : fRunning(false), fStopping(false), fBusy(false) {}
+    ~CValidationQueue() { Stop(); }
+
+    void Start()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fRunning)
+            return;
+        fRunning = true;
+        thread = boost::thread(&CValidationQueue::Thread, this);
+    }
+
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (!thread.joinable() || IsQueueThread())
+                return;
+            fStopping = true;
+        }
+        condWork.notify_all();
+        thread.join();
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStopping = false;
+    }
+
+    void Dispatch(std::function<void()> func)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (fRunning) {
+                queue.push_back(std::move(func));
+                condWork.notify_one();
+                return;
+            }
+        }
+        func();
+    }
+
+    /** Wait until at most nSize notifications are left, or none at all are pending for nSize 0 */
+    void WaitForSize(size_t nSize)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (IsQueueThread())
+            return;
+        while (fRunning && (queue.size() > nSize || (nSize == 0 && fBusy)))
+            condDone.wait(lock);
+    }
+};
+
+/** Queue of a registered listener together with the signal connections that feed it */
+struct CValidationSubscriber {
+    CValidationQueue queue;
+    boost::signals2::connection connUpdatedBlockTip;
+    boost::signals2::connection connSyncTransaction;
+    boost::signals2::connection connSetBestChain;
+};
+
+boost::mutex cs_subscribers;
+std::map<CValidationInterface*, std::unique_ptr<CValidationSubscriber> > mapSubscribers;
+bool fQueueStarted = false;
+} // namespace
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -15,11 +142,31 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 // XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    {
+        boost::unique_lock<boost::mutex> lock(cs_subscribers);
+        std::unique_ptr<CValidationSubscriber>& subscriber = mapSubscribers[pwalletIn];
+        if (!subscriber)
+            subscriber.reset(new CValidationSubscriber());
+        CValidationQueue* queue = &subscriber->queue;
+        std::function<void(const CBlockIndex*)> updatedBlockTip = boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1);
+        std::function<void(const CTransaction&, const CBlock*)> syncTransaction = boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2);
+        std::function<void(const CBlockLocator&)> setBestChain = boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1);
+        subscriber->connUpdatedBlockTip = g_signals.UpdatedBlockTip.connect([queue, updatedBlockTip](const CBlockIndex* pindex) {
+            queue->Dispatch([updatedBlockTip, pindex] { updatedBlockTip(pindex); });
+        });
+        // The transaction is copied and the block shared so both outlive the caller
+        subscriber->connSyncTransaction = g_signals.SyncTransaction.connect([queue, syncTransaction](const CTransaction& tx, const std::shared_ptr<const CBlock>& pblock) {
+            queue->Dispatch([syncTransaction, tx, pblock] { syncTransaction(tx, pblock.get()); });
+        });
+        // Queued behind the transactions so the locator never gets ahead of what was synced
+        subscriber->connSetBestChain = g_signals.SetBestChain.connect([queue, setBestChain](const CBlockLocator& locator) {
+            queue->Dispatch([setBestChain, locator] { setBestChain(locator); });
+        });
+        if (fQueueStarted)
+            queue->Start();
+    }
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
@@ -33,12 +180,24 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn));
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 // XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
+
+    // Deliver what is still queued before the listener goes away
+    std::unique_ptr<CValidationSubscriber> subscriber;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_subscribers);
+        auto it = mapSubscribers.find(pwalletIn);
+        if (it == mapSubscribers.end())
+            return;
+        subscriber = std::move(it->second);
+        mapSubscribers.erase(it);
+    }
+    subscriber->connSetBestChain.disconnect();
+    subscriber->connSyncTransaction.disconnect();
+    subscriber->connUpdatedBlockTip.disconnect();
+    subscriber->queue.Stop();
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -53,8 +212,46 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 // XX42    g_signals.EraseTransaction.disconnect_all_slots();
+
+    std::map<CValidationInterface*, std::unique_ptr<CValidationSubscriber> > mapStopped;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_subscribers);
+        mapStopped.swap(mapSubscribers);
+    }
+    for (auto& item : mapStopped)
+        item.second->queue.Stop();
 }
 
-void SyncWithWallets(const CTransaction &tx, const CBlock *pblock = nullptr) {
+void SyncWithWallets(const CTransaction &tx, const std::shared_ptr<const CBlock> &pblock) {
     g_signals.SyncTransaction(tx, pblock);
 }
+
+void StartValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_subscribers);
+    fQueueStarted = true;
+    for (auto& item : mapSubscribers)
+        item.second->queue.Start();
+}
+
+void StopValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_subscribers);
+    fQueueStarted = false;
+    for (auto& item : mapSubscribers)
+        item.second->queue.Stop();
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_subscribers);
+    for (auto& item : mapSubscribers)
+        item.second->queue.WaitForSize(0);
+}
+
+void LimitValidationInterfaceQueue()
+{
+    boost::unique_lock<boost::mutex> lock(cs_subscribers);
+    for (auto& item : mapSubscribers)
+        item.second->queue.WaitForSize(MAX_VALIDATION_INTERFACE_QUEUE_SIZE);
+}
@@ -10,6 +10,8 @@
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <memory>
+
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
@@ -19,6 +21,9 @@ class CValidationInterface;
 class CValidationState;
 class uint256;
 
+/** Maximum number of notifications queued for a single listener before block processing waits for it */
+static const unsigned int MAX_VALIDATION_INTERFACE_QUEUE_SIZE = 5000;
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -28,7 +33,20 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
+void SyncWithWallets(const CTransaction& tx, const std::shared_ptr<const CBlock>& pblock);
+
+/**
+ * SyncTransaction, UpdatedBlockTip and SetBestChain are delivered inline until the queue is started.
+ * After that every listener gets them in order on its own thread, so a slow listener
+ * does not hold up block connection.
+ */
+void StartValidationInterfaceQueue();
+/** Deliver everything still queued and go back to inline delivery */
+void StopValidationInterfaceQueue();
+/** Wait until every listener has handled the notifications queued so far. Must not be called with cs_main held. */
+void SyncWithValidationInterfaceQueue();
+/** Wait until no listener is more than MAX_VALIDATION_INTERFACE_QUEUE_SIZE notifications behind. Must not be called with cs_main held. */
+void LimitValidationInterfaceQueue();
 
 class CValidationInterface {
 protected:
@@ -54,7 +72,7 @@ struct CMainSignals {
     /** Notifies listeners of updated block chain tip */
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
-    boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
+    boost::signals2::signal<void (const CTransaction &, const std::shared_ptr<const CBlock> &)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
@@ -747,6 +747,58 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         if (!txin.IsZerocoinSpend() && mapWallet.count(txin.prevout.hash))
             mapWallet[txin.prevout.hash].MarkDirty();
     }
+
+    // Keep the stakeable outputs in step
+    if (!fStakeableOutputsDirty) {
+        const CWalletTx& wtx = mapWallet[tx.GetHash()];
+        if (!pblock && wtx.hashBlock != 0) {
+            // Disconnected, the outputs it spent may be stakeable again
+            fStakeableOutputsDirty = true;
+        } else {
+            for (const CTxIn& txin : tx.vin)
+                mapStakeableOutputs.erase(txin.prevout);
+            if (pblock)
+                AddStakeableOutputs(wtx);
+        }
+    }
+}
+
+void CWallet::AddStakeableOutputs(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    BlockMap::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return;
+    CBlockIndex* pindexFrom = mi->second;
+
+    //if zerocoinspend, then use the block time
+    int64_t nTxTime = wtx.vin[0].IsZerocoinSpend() ? pindexFrom->GetBlockTime() : wtx.GetTxTime();
+
+    //coinbase and coinstake outputs mature past COINBASE_MATURITY, others after 10 confirmations
+    int nDepthMature = (wtx.IsCoinBase() || wtx.IsCoinStake()) ? Params().COINBASE_MATURITY() + 1 : 10;
+
+    const uint256& wtxid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (wtx.vout[i].nValue <= 0 || wtx.vout[i].IsZerocoinMint())
+            continue;
+
+        isminetype mine = IsMine(wtx.vout[i]);
+        if (mine == ISMINE_NO || mine == ISMINE_WATCH_ONLY)
+            continue;
+        if (IsSpent(wtxid, i))
+            continue;
+
+        mapStakeableOutputs.emplace(COutPoint(wtxid, i), CStakeableOutput(&wtx, i, pindexFrom, nTxTime, pindexFrom->nHeight + nDepthMature - 1));
+    }
+}
+
+void CWallet::RebuildStakeableOutputs()
+{
+    AssertLockHeld(cs_wallet);
+    mapStakeableOutputs.clear();
+    for (const auto& it : mapWallet)
+        AddStakeableOutputs(it.second);
+    fStakeableOutputsDirty = false;
 }
 
 void CWallet::EraseFromWallet(const uint256& hash)
@@ -757,6 +809,7 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        fStakeableOutputsDirty = true;
     }
     return;
 }
@@ -1792,38 +1845,49 @@ bool less_then_denom(const COutput& out1, const COutput& out2)
 
 bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount, bool fPrecompute)
 {
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_wallet);
+    if (fStakeableOutputsDirty)
+        RebuildStakeableOutputs();
+
     //Add WSP
-    std::vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, nullptr, false, STAKABLE_COINS);
     CAmount nAmountSelected = 0;
     if (GetBoolArg("-wspstake", true) && !fPrecompute) {
-        for (const COutput &out : vCoins) {
+        int nHeight = chainActive.Height();
+        for (auto& it : mapStakeableOutputs) {
+            CStakeableOutput& out = it.second;
+            CAmount nValue = out.tx->vout[out.i].nValue;
+
             //make sure not to outrun target amount
-            if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
+            if (nAmountSelected + nValue > nTargetAmount)
                 continue;
 
-            //if zerocoinspend, then use the block time
-            int64_t nTxTime = out.tx->GetTxTime();
-            if (out.tx->vin[0].IsZerocoinSpend()) {
-                if (!out.tx->IsInMainChain())
-                    continue;
-                nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
-            }
-
             //check for min age
-            if (GetAdjustedTime() - nTxTime < GetStakeMinAge() && Params().NetworkID() != CBaseChainParams::REGTEST)
+            if (GetAdjustedTime() - out.nTxTime < GetStakeMinAge() && Params().NetworkID() != CBaseChainParams::REGTEST)
                 continue;
 
             //check that it is matured
-            if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
+            if (nHeight < out.nHeightMature)
+                continue;
+
+            //spent by an unconfirmed transaction or locked
+            if (IsSpent(it.first.hash, it.first.n) || IsLockedCoin(it.first.hash, it.first.n))
                 continue;
 
+            //the modifier is known once a selection interval of blocks follows the origin block
+            if (!out.fStakeModifier) {
+                int nStakeModifierHeight = 0;
+                int64_t nStakeModifierTime = 0;
+                if (!GetKernelStakeModifier(out.pindexFrom->GetBlockHash(), out.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+                    continue;
+                out.fStakeModifier = true;
+            }
+
             //add to our stake set
-            nAmountSelected += out.tx->vout[out.i].nValue;
+            nAmountSelected += nValue;
 
             std::unique_ptr<CWspStake> input(new CWspStake());
             input->SetInput((CTransaction) *out.tx, out.i);
+            input->SetIndexFrom(out.pindexFrom, out.nStakeModifier);
             listInputs.emplace_back(std::move(input));
         }
     }
@@ -1875,18 +1939,12 @@ bool CWallet::MintableCoins()
         if (nBalance <= nReserveBalance)
             return false;
 
-        std::vector<COutput> vCoins;
-        AvailableCoins(vCoins, true);
-
-        for (const COutput& out : vCoins) {
-            int64_t nTxTime = out.tx->GetTxTime();
-            if (out.tx->vin[0].IsZerocoinSpend()) {
-                if (!out.tx->IsInMainChain())
-                    continue;
-                nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
-            }
+        LOCK(cs_wallet);
+        if (fStakeableOutputsDirty)
+            RebuildStakeableOutputs();
 
-            if (Params().NetworkID() == CBaseChainParams::REGTEST || GetAdjustedTime() - nTxTime >= GetStakeMinAge())
+        for (const auto& it : mapStakeableOutputs) {
+            if (Params().NetworkID() == CBaseChainParams::REGTEST || GetAdjustedTime() - it.second.nTxTime >= GetStakeMinAge())
                 return true;
         }
     }
@@ -2378,101 +2436,97 @@ bool CWallet::CreateCoinStake(
         }
     }
 
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested())
+        return false;
+
+    // Hash the time slots of all the inputs in one pass
+    nTxNewTime = GetAdjustedTime();
+    std::vector<CStakeKernelHit> vHits;
+    int nAttempts = 0;
+    bool fSearched = SearchStakeKernels(listInputs, nBits, nTxNewTime, vHits, nAttempts);
+    LogPrint("staking", "%s: attempted staking %d times\n", __func__, nAttempts);
+    if (!fSearched)
+        return false;
+
     CAmount nCredit;
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
-    int nAttempts = 0;
-    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
+    for (const CStakeKernelHit& hit : vHits) {
         nCredit = 0;
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested())
             return false;
 
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = stakeInput->GetIndexFrom();
-        if (!pindex || pindex->nHeight < 1) {
-            LogPrintf("CreateCoinStake(): no pindexfrom\n");
+        CStakeInput* stakeInput = hit.stakeInput;
+        nTxNewTime = hit.nTimeTx;
+        //Double check that this will pass time requirements
+        if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast() && Params().NetworkID() != CBaseChainParams::REGTEST) {
+            LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
             continue;
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-        uint256 hashProofOfStake = 0;
-        nTxNewTime = GetAdjustedTime();
-        nAttempts++;
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast() && Params().NetworkID() != CBaseChainParams::REGTEST) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+        // Found a kernel
+        LogPrintf("CreateCoinStake : kernel found\n");
+        nCredit += stakeInput->GetValue();
 
-            // Found a kernel
-            LogPrintf("CreateCoinStake : kernel found\n");
-            nCredit += stakeInput->GetValue();
+        // Calculate reward
+        CAmount nReward;
+        nReward = GetBlockValue(chainActive.Height() + 1);
+        nCredit += nReward;
 
-            // Calculate reward
-            CAmount nReward;
-            nReward = GetBlockValue(chainActive.Height() + 1);
-            nCredit += nReward;
-
-            // Create the output transaction(s)
-            std::vector<CTxOut> vout;
-            if (!stakeInput->CreateTxOuts(this, vout, nCredit)) {
-                LogPrintf("%s : failed to get scriptPubKey\n", __func__);
-                continue;
-            }
-            txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-            CAmount nMinFee = 0;
-            if (!stakeInput->IsZWSP()) {
-                // Set output amount
-                if (txNew.vout.size() == 3) {
-                    txNew.vout[1].nValue = ((nCredit - nMinFee) / 2 / CENT) * CENT;
-                    txNew.vout[2].nValue = nCredit - nMinFee - txNew.vout[1].nValue;
-                } else
-                    txNew.vout[1].nValue = nCredit - nMinFee;
-            }
+        // Create the output transaction(s)
+        std::vector<CTxOut> vout;
+        if (!stakeInput->CreateTxOuts(this, vout, nCredit)) {
+            LogPrintf("%s : failed to get scriptPubKey\n", __func__);
+            continue;
+        }
+        txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
 
-            // Limit size
-            unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
-                return error("CreateCoinStake : exceeded coinstake size limit");
+        CAmount nMinFee = 0;
+        if (!stakeInput->IsZWSP()) {
+            // Set output amount
+            if (txNew.vout.size() == 3) {
+                txNew.vout[1].nValue = ((nCredit - nMinFee) / 2 / CENT) * CENT;
+                txNew.vout[2].nValue = nCredit - nMinFee - txNew.vout[1].nValue;
+            } else
+                txNew.vout[1].nValue = nCredit - nMinFee;
+        }
 
-            //Masternode payment
-            FillBlockPayee(txNew, nMinFee, true, stakeInput->IsZWSP());
+        // Limit size
+        unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
+            return error("CreateCoinStake : exceeded coinstake size limit");
 
-            {
-                TRY_LOCK(zwspTracker->cs_spendcache, fLocked);
-                if (!fLocked)
-                    continue;
+        //Masternode payment
+        FillBlockPayee(txNew, nMinFee, true, stakeInput->IsZWSP());
 
-                uint256 hashTxOut = txNew.GetHash();
-                CTxIn in;
-                if (!stakeInput->CreateTxIn(this, in, hashTxOut)) {
-                    LogPrintf("%s : failed to create TxIn\n", __func__);
-                    txNew.vin.clear();
-                    txNew.vout.clear();
-                    continue;
-                }
-                txNew.vin.emplace_back(in);
-            }
+        {
+            TRY_LOCK(zwspTracker->cs_spendcache, fLocked);
+            if (!fLocked)
+                continue;
 
-            //Mark mints as spent
-            if (stakeInput->IsZWSP()) {
-                auto* z = (CZWspStake*)stakeInput.get();
-                if (!z->MarkSpent(this, txNew.GetHash()))
-                    return error("%s: failed to mark mint as used\n", __func__);
+            uint256 hashTxOut = txNew.GetHash();
+            CTxIn in;
+            if (!stakeInput->CreateTxIn(this, in, hashTxOut)) {
+                LogPrintf("%s : failed to create TxIn\n", __func__);
+                txNew.vin.clear();
+                txNew.vout.clear();
+                continue;
             }
+            txNew.vin.emplace_back(in);
+        }
 
-            fKernelFound = true;
-            break;
+        //Mark mints as spent
+        if (stakeInput->IsZWSP()) {
+            auto* z = (CZWspStake*)stakeInput;
+            if (!z->MarkSpent(this, txNew.GetHash()))
+                return error("%s: failed to mark mint as used\n", __func__);
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+
+        fKernelFound = true;
+        break;
     }
-    LogPrint("staking", "%s: attempted staking %d times\n", __func__, nAttempts);
 
     if (!fKernelFound)
         return false;
@@ -4843,14 +4897,25 @@ void CWallet::PrecomputeSpends()
             nLastCacheWriteDB = nLastCacheCleanUpTime;
         }
 
-        // Get the list of zWSP inputs
-        std::list <std::unique_ptr<CStakeInput>> listInputs;
-        if (!SelectStakeCoins(listInputs, 0, true)) {
-            MilliSleep(5000);
-            continue;
+        // Keep a witness for every unspent mature zWSP mint, so that spends only
+        // need to accumulate the blocks added since the last precompute round
+        std::vector<uint256> vStakeHashes;
+        {
+            LOCK2(cs_main, cs_wallet);
+            for (CMintMeta meta : zwspTracker->ListMints(true, true, false)) {
+                if (meta.hashStake == 0) {
+                    CZerocoinMint mint;
+                    if (!GetMint(meta.hashSerial, mint))
+                        continue;
+                    uint256 hashStake = mint.GetSerialNumber().getuint256();
+                    meta.hashStake = Hash(hashStake.begin(), hashStake.end());
+                    zwspTracker->UpdateState(meta);
+                }
+                vStakeHashes.emplace_back(meta.hashStake);
+            }
         }
 
-        if (listInputs.empty()) {
+        if (vStakeHashes.empty()) {
             MilliSleep(5000);
             continue;
         }
@@ -4872,7 +4937,7 @@ void CWallet::PrecomputeSpends()
 
         // Do some precomputing of zerocoin spend knowledge proofs
         std::set <uint256> setInputHashes;
-        for (std::unique_ptr <CStakeInput>& stakeInput : listInputs) {
+        for (const uint256& serialHash : vStakeHashes) {
             if (ShutdownRequested() || IsLocked())
                 break;
 
@@ -4893,7 +4958,6 @@ void CWallet::PrecomputeSpends()
                     break;
                 }
 
-                uint256 serialHash = stakeInput->GetSerialHash();
                 setInputHashes.insert(serialHash);
                 CoinWitnessData* witnessData = zwspTracker->GetSpendCache(serialHash);
 
@@ -162,6 +162,34 @@ public:
     StringMap destdata;
 };
 
+/** A wallet output that can be staked, with what the staker needs resolved when it was added */
+class CStakeableOutput
+{
+public:
+    const CWalletTx* tx;
+    unsigned int i;
+    //! Block of the main chain that contains the output
+    CBlockIndex* pindexFrom;
+    //! Time used for the stake min age
+    int64_t nTxTime;
+    //! First chain height at which the output is mature enough to stake
+    int nHeightMature;
+    //! Kernel stake modifier, resolved once enough blocks follow pindexFrom
+    bool fStakeModifier;
+    uint64_t nStakeModifier;
+
+    CStakeableOutput(const CWalletTx* txIn, unsigned int iIn, CBlockIndex* pindexFromIn, int64_t nTxTimeIn, int nHeightMatureIn)
+    {
+        tx = txIn;
+        i = iIn;
+        pindexFrom = pindexFromIn;
+        nTxTime = nTxTimeIn;
+        nHeightMature = nHeightMatureIn;
+        fStakeModifier = false;
+        nStakeModifier = 0;
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -195,6 +223,16 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Confirmed outputs that can be staked, so the staker does not walk mapWallet on every attempt.
+     * Spent outputs are dropped and new ones added by SyncTransaction. A disconnected transaction
+     * marks the set dirty and it is rebuilt from mapWallet on the next use.
+     */
+    std::map<COutPoint, CStakeableOutput> mapStakeableOutputs;
+    bool fStakeableOutputsDirty;
+    void AddStakeableOutputs(const CWalletTx& wtx);
+    void RebuildStakeableOutputs();
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount, bool fPrecompute = false);
@@ -310,6 +348,7 @@ public:
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        fStakeableOutputsDirty = true;
 
         // Stake Settings
         nHashDrift = 45;
@@ -266,9 +266,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
     if (!InitializeAccumulators(nHeight, nHeightCheckpoint, mapAccumulators))
         return error("%s: failed to initialize accumulators", __func__);
 
-    //Whether this should filter out invalid/fraudulent outpoints
-    bool fFilterInvalid = nHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT();
-
+    //Heights below NEW_PROTOCOLS_STARTHEIGHT returned above, so invalid/fraudulent outpoints are always filtered out
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
     int nTotalMintsFound = 0;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
@@ -285,12 +283,8 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
-            return error("%s: failed to read block from disk", __func__);
-
         std::list<libzerocoin::PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
+        if (!BlockIndexToPubcoinList(pindex, listPubcoins))
             return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
 
         nTotalMintsFound += listPubcoins.size();
@@ -356,7 +350,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
     int n = 0;
     while (pindex->nHeight < nHeightEnd) {
-        n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+        n += count(pindex->cold->vMintDenominationsInBlock.begin(), pindex->cold->vMintDenominationsInBlock.end(), denom);
         pindex = chainActive.Next(pindex);
     }
 
@@ -366,42 +360,14 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex){
     //grab mints from this block
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pindex))
-        throw GetPubcoinException("GetPubcoinFromBlock: failed to read block from disk while adding pubcoins to witness");
     std::list<libzerocoin::PublicCoin> listPubcoins;
-    if(!BlockToPubcoinList(block, listPubcoins, true))
+    if(!BlockIndexToPubcoinList(pindex, listPubcoins))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
     return listPubcoins;
 }
 
 
 
-int AddBlockMintsToAccumulator(const libzerocoin::CoinDenomination den, const CBloomFilter& filter, const CBlockIndex* pindex,
-                               libzerocoin::Accumulator* accumulator, bool isWitness, std::list<CBigNum>& notAddedCoins)
-{
-    // if this block contains mints of the denomination that is being spent, then add them to the witness
-    int nMintsAdded = 0;
-    if (pindex->MintedDenomination(den)) {
-        //add the mints to the witness
-        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
-            if (pubcoin.getDenomination() != den) {
-                continue;
-            }
-
-            if (isWitness && filter.contains(pubcoin.getValue().getvch())) {
-                notAddedCoins.emplace_back(pubcoin.getValue());
-                continue;
-            }
-
-            accumulator->increment(pubcoin.getValue());
-            ++nMintsAdded;
-        }
-    }
-
-    return nMintsAdded;
-}
-
 int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nHeightMintAdded, const CBlockIndex* pindex,
                                libzerocoin::Accumulator* accumulator, bool isWitness)
 {
@@ -518,6 +484,7 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
     while (pindex && pindex->nHeight <= nHeightEnd) {
         coinWitness->nMintsAdded += AddBlockMintsToAccumulator(coinWitness, pindex, true);
         coinWitness->nHeightAccEnd = pindex->nHeight;
+        coinWitness->hashAccEnd = pindex->GetBlockHash();
 
         // 10 blocks were accumulated twice when zWSP v2 was activated
         if (pindex->nHeight == Params().Zerocoin_Block_Double_Accumulated() + 10 && !fDoubleCounted) {
@@ -543,6 +510,15 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
 
         int64_t nTimeStart = GetTimeMicros();
 
+        // A partial accumulation that ends in a block no longer in the active chain must be redone
+        if (coinWitness->nHeightAccEnd && (coinWitness->nHeightAccEnd > chainActive.Height() ||
+                                           chainActive[coinWitness->nHeightAccEnd]->GetBlockHash() != coinWitness->hashAccEnd)) {
+            LogPrint("zero", "%s: accumulation end %d is not in the active chain, restarting\n", __func__, coinWitness->nHeightAccEnd);
+            coinWitness->nHeightAccEnd = 0;
+            coinWitness->nMintsAdded = 0;
+            coinWitness->hashAccEnd.SetNull();
+        }
+
         //If there is a Acc End height filled in, then this has already been partially accumulated.
         if (!coinWitness->nHeightAccEnd) {
             LogPrintf("RESET ACC\n");
@@ -606,61 +582,6 @@ bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& ma
     }
 }
 
-bool calculateAccumulatedBlocksFor(
-        int startHeight,
-        int nHeightStop,
-        CBlockIndex *pindex,
-        CBigNum &bnAccValue,
-        libzerocoin::Accumulator &accumulator,
-        libzerocoin::CoinDenomination den,
-        const CBloomFilter& filter,
-        libzerocoin::Accumulator &witnessAccumulator,
-        std::list<CBigNum>& ret,
-        std::string& strError
-){
-    bool fDoubleCounted = false;
-    int nMintsAdded = 0;
-    while (pindex) {
-
-        if (pindex->nHeight >= nHeightStop) {
-            //If this height is within the invalid range (when fraudulent coins were being minted), then continue past this range
-            if(InvalidCheckpointRange(pindex->nHeight))
-                continue;
-
-            bnAccValue = 0;
-            uint256 nCheckpointSpend = chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint;
-            if (!GetAccumulatorValueFromDB(nCheckpointSpend, den, bnAccValue) || bnAccValue == 0) {
-                throw new ChecksumInDbNotFoundException(
-                        "calculateAccumulatedBlocksFor : failed to find checksum in database for accumulator");
-            }
-            accumulator.setValue(bnAccValue);
-            break;
-        }
-
-        nMintsAdded += AddBlockMintsToAccumulator(den, filter, pindex, &witnessAccumulator, true, ret);
-
-        // 10 blocks were accumulated twice when zWSP v2 was activated
-        if (pindex->nHeight == 1050010 && !fDoubleCounted) {
-            pindex = chainActive[1050000];
-            fDoubleCounted = true;
-            continue;
-        }
-
-        pindex = chainActive.Next(pindex);
-    }
-
-    // A certain amount of accumulated coins are required
-    if (nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
-        strError = _(strprintf("Less than %d mints added, unable to create spend",
-                               Params().Zerocoin_RequiredAccumulation()).c_str());
-        throw NotEnoughMintsException(strError);
-    }
-
-    LogPrintf("calculateAccumulatedBlocksFor() : nMintsAdded %d",nMintsAdded);
-
-    return true;
-}
-
 bool calculateAccumulatedBlocksFor(
         int startHeight,
         int nHeightStop,
@@ -721,37 +642,32 @@ bool calculateAccumulatedBlocksFor(
 }
 
 
-bool CalculateAccumulatorWitnessFor(
+bool CalculateAccumulatorWitnessesFor(
         const libzerocoin::ZerocoinParams* params,
         int startHeight,
         int maxCalulationRange,
         libzerocoin::CoinDenomination den,
-        const CBloomFilter& filter,
+        const std::vector<const CBloomFilter*>& vFilters,
         libzerocoin::Accumulator& accumulator,
-        libzerocoin::AccumulatorWitness& witness,
-        int& nMintsAdded,
-        std::string& strError,
-        std::list<CBigNum>& ret,
+        std::vector<CBigNum>& vWitnessValues,
+        std::vector<int>& vMintsAdded,
+        std::vector<std::list<CBigNum> >& vRet,
         int &heightStop
 ){
     // Lock
     if (!LockMethod()) return false;
 
     try {
-        // Dummy coin init
-        libzerocoin::PublicCoin temp(params, 0, den);
-        // Dummy Acc init
-        libzerocoin::Accumulator testingAcc(params, den);
-
         //get the checkpoint added at the next multiple of 10
         int nHeightCheckpoint = startHeight + (10 - (startHeight % 10));
 
-        // Get the base accumulator
+        // Get the base accumulator, every witness starts on top of it
         // TODO: This needs to be changed to the partial witness calculation on the next version.
         CBigNum bnAccValue = 0;
         if (GetAccumulatorValue(nHeightCheckpoint, den, bnAccValue)) {
             accumulator.setValue(bnAccValue);
-            witness.resetValue(accumulator, temp);
+            for (CBigNum& bnWitnessValue : vWitnessValues)
+                bnWitnessValue = accumulator.getValue();
         }
 
         // Add the pubcoins from the blockchain up to the next checksum starting from the block
@@ -762,41 +678,69 @@ bool CalculateAccumulatorWitnessFor(
 
         if (nHeightStop - startHeight > maxCalulationRange) {
             int stop = (startHeight + maxCalulationRange);
-            int nHeightStop = stop % 10;
-            nHeightStop = stop - nHeightStop - 20;
+            nHeightStop = stop - (stop % 10) - 20;
         }
         heightStop = nHeightStop;
 
-        nMintsAdded = 0;
+        // Starts on top of the witness that each node sent
+        std::vector<libzerocoin::Accumulator> vWitnessAccumulators;
+        for (const CBigNum& bnWitnessValue : vWitnessValues)
+            vWitnessAccumulators.emplace_back(params, den, bnWitnessValue);
+        vMintsAdded.assign(vFilters.size(), 0);
+        vRet.assign(vFilters.size(), std::list<CBigNum>());
+
+        // One pass over the blocks, the pubcoins of each block are applied to every request
+        bool fDoubleCounted = false;
+        while (pindex) {
+            if (pindex->nHeight >= nHeightStop) {
+                //If this height is within the invalid range (when fraudulent coins were being minted), then continue past this range
+                if (InvalidCheckpointRange(pindex->nHeight)) {
+                    pindex = chainActive.Next(pindex);
+                    continue;
+                }
+
+                bnAccValue = 0;
+                uint256 nCheckpointSpend = chainActive[pindex->nHeight + 10]->nAccumulatorCheckpoint;
+                if (!GetAccumulatorValueFromDB(nCheckpointSpend, den, bnAccValue) || bnAccValue == 0)
+                    return error("%s: failed to find checksum in database for accumulator", __func__);
+                accumulator.setValue(bnAccValue);
+                break;
+            }
 
-        // Starts on top of the witness that the node sent
-        libzerocoin::Accumulator witnessAccumulator(params, den, witness.getValue());
+            if (pindex->MintedDenomination(den)) {
+                for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
+                    if (pubcoin.getDenomination() != den)
+                        continue;
+
+                    const std::vector<unsigned char> vchPubcoin = pubcoin.getValue().getvch();
+                    for (unsigned int i = 0; i < vFilters.size(); i++) {
+                        if (vFilters[i]->contains(vchPubcoin)) {
+                            vRet[i].emplace_back(pubcoin.getValue());
+                            continue;
+                        }
+                        vWitnessAccumulators[i].increment(pubcoin.getValue());
+                        ++vMintsAdded[i];
+                    }
+                }
+            }
 
-        if(!calculateAccumulatedBlocksFor(
-                startHeight,
-                nHeightStop,
-                pindex,
-                bnAccValue,
-                accumulator,
-                den,
-                filter,
-                witnessAccumulator,
-                ret,
-                strError
-        ))
-            return error("CalculateAccumulatorWitnessFor(): Calculate accumulated coins failed");
+            // 10 blocks were accumulated twice when zWSP v2 was activated
+            if (pindex->nHeight == 1050010 && !fDoubleCounted) {
+                pindex = chainActive[1050000];
+                fDoubleCounted = true;
+                continue;
+            }
+
+            pindex = chainActive.Next(pindex);
+        }
 
-        // reset the value
-        witness.resetValue(witnessAccumulator, temp);
+        for (unsigned int i = 0; i < vWitnessAccumulators.size(); i++)
+            vWitnessValues[i] = vWitnessAccumulators[i].getValue();
 
-        // calculate how many mints of this denomination existed in the accumulator we initialized
-        nMintsAdded += ComputeAccumulatedCoins(startHeight, den);
-        LogPrint("zero", "%s : %d mints added to witness\n", __func__, nMintsAdded);
+        LogPrint("zero", "%s : calculated %d witnesses from height %d to %d\n", __func__, vFilters.size(), startHeight, heightStop);
 
         return true;
 
-    } catch (ChecksumInDbNotFoundException e) {
-        return error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
     } catch (GetPubcoinException e) {
         return error("%s: GetPubcoinException: %s", __func__, e.message);
     }
@@ -910,8 +854,8 @@ std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight()
         for (auto denom : libzerocoin::zerocoinDenomList) {
             //If the denom has not already had a mint added to it, then see if it has a mint added on this block
             if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-                mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-                                                          pindex->vMintDenominationsInBlock.end(), denom);
+                mapDenomMaturity.at(denom).first += count(pindex->cold->vMintDenominationsInBlock.begin(),
+                                                          pindex->cold->vMintDenominationsInBlock.end(), denom);
 
                 //if mint was found then record this block as the first block that maturity occurs.
                 if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
@@ -21,21 +21,21 @@ class CBlockIndex;
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
 
 /**
- * Calculate the acc witness for a single coin.
- * @return true if the witness was calculated well
+ * Calculate the acc witnesses of a set of light wallet requests that share the starting
+ * height and denomination, reading the block range only once. Each request excludes the
+ * pubcoins matched by its filter (returned in vRet) and reports how many were added.
+ * @return true if the witnesses were calculated well
  */
-
-bool CalculateAccumulatorWitnessFor(
+bool CalculateAccumulatorWitnessesFor(
         const libzerocoin::ZerocoinParams* params,
         int startingHeight,
         int maxCalculationRange,
         libzerocoin::CoinDenomination den,
-        const CBloomFilter& filter,
+        const std::vector<const CBloomFilter*>& vFilters,
         libzerocoin::Accumulator& accumulator,
-        libzerocoin::AccumulatorWitness& witness,
-        int& nMintsAdded,
-        std::string& strError,
-        std::list<CBigNum>& ret,
+        std::vector<CBigNum>& vWitnessValues,
+        std::vector<int>& vMintsAdded,
+        std::vector<std::list<CBigNum> >& vRet,
         int &heightStop
 );
 
@@ -16,6 +16,7 @@ void CoinWitnessData::SetNull()
     nHeightCheckpoint = 0;
     nHeightAccStart = 0;
     nHeightAccEnd = 0;
+    hashAccEnd.SetNull();
 }
 
 CoinWitnessData::CoinWitnessData()
@@ -60,6 +61,7 @@ CoinWitnessData::CoinWitnessData(CoinWitnessCacheData& data)
     nHeightCheckpoint = data.nHeightCheckpoint;
     nHeightAccStart = data.nHeightAccStart;
     nHeightAccEnd = data.nHeightAccEnd;
+    hashAccEnd = data.hashAccEnd;
     txid = data.txid;
 }
 
@@ -79,6 +81,7 @@ void CoinWitnessCacheData::SetNull()
     nHeightCheckpoint = 0;
     nHeightAccStart = 0;
     nHeightAccEnd = 0;
+    hashAccEnd.SetNull();
     coinAmount = CBigNum(0);
     coinDenom = libzerocoin::CoinDenomination::ZQ_ERROR;
     accumulatorAmount = CBigNum(0);
@@ -102,6 +105,7 @@ CoinWitnessCacheData::CoinWitnessCacheData(CoinWitnessData* coinWitnessData)
     nHeightCheckpoint = coinWitnessData->nHeightCheckpoint;
     nHeightAccStart = coinWitnessData->nHeightAccStart;
     nHeightAccEnd = coinWitnessData->nHeightAccEnd;
+    hashAccEnd = coinWitnessData->hashAccEnd;
     coinAmount = coinWitnessData->coin->getValue();
     coinDenom = coinWitnessData->coin->getDenomination();
     accumulatorAmount = coinWitnessData->pAccumulator->getValue();
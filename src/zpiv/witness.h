@@ -29,6 +29,7 @@ public:
     int nHeightAccStart;
     int nHeightAccEnd;
     int nMintsAdded;
+    uint256 hashAccEnd; // block at nHeightAccEnd, to detect reorganizations
     uint256 txid;
     bool isV1;
 
@@ -49,6 +50,7 @@ public:
     int nHeightAccStart;
     int nHeightAccEnd;
     int nMintsAdded;
+    uint256 hashAccEnd;
     uint256 txid;
     bool isV1;
     CBigNum coinAmount;
@@ -77,6 +79,13 @@ public:
         READWRITE(coinDenom);
         READWRITE(accumulatorAmount); // used to create the pAccumulator
         READWRITE(accumulatorDenom);
+
+        try {
+            READWRITE(hashAccEnd);
+        } catch (...) {
+            // written before the end block was recorded, the witness gets rebuilt
+            hashAccEnd.SetNull();
+        }
     };
 };
 #endif //PIVX_WITNESS_H
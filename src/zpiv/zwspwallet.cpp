@@ -11,6 +11,11 @@
 #include "deterministicmint.h"
 #include "zwspchain.h"
 
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <mutex>
+
 
 CzWSPWallet::CzWSPWallet(const std::string& strWalletFile)
 {
@@ -103,12 +108,12 @@ void CzWSPWallet::AddToMintPool(const std::pair<uint256, uint32_t>& pMint, bool
 }
 
 //Add the next 20 mints to the mint pool
-void CzWSPWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
+bool CzWSPWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
 {
 
     //Is locked
     if (seedMaster == 0)
-        return;
+        return true;
 
     uint32_t n = nCountLastUsed + 1;
 
@@ -119,38 +124,70 @@ void CzWSPWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
     if (nCountEnd > 0)
         nStop = std::max(n, n + nCountEnd);
 
-    bool fFound;
-
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     LogPrintf("%s : n=%d nStop=%d\n", __func__, n, nStop - 1);
-    for (uint32_t i = n; i < nStop; ++i) {
-        if (ShutdownRequested())
-            return;
-
-        fFound = false;
 
-        // Prevent unnecessary repeated minted
-        for (auto& pair : mintPool) {
-            if(pair.second == i) {
-                fFound = true;
-                break;
+    // Prevent unnecessary repeated minted
+    std::vector<uint32_t> vCounts;
+    for (uint32_t i = n; i < nStop; ++i) {
+        if (!mintPool.HasCount(i))
+            vCounts.emplace_back(i);
+    }
+    if (vCounts.empty())
+        return true;
+
+    // Every mint is derived independently from its own seed, so spread the derivation over all cores
+    std::vector<CBigNum> vValues(vCounts.size());
+    unsigned int nThreads = std::max(1u, std::min((unsigned int)vCounts.size(), boost::thread::hardware_concurrency()));
+    boost::thread_group threadGroup;
+    std::atomic<bool> fFailed(false);
+    std::mutex csError;
+    std::string strError;
+    for (unsigned int t = 0; t < nThreads; t++) {
+        threadGroup.create_thread([this, t, nThreads, &vCounts, &vValues, &fFailed, &csError, &strError]() {
+            try {
+                for (unsigned int j = t; j < vCounts.size(); j += nThreads) {
+                    if (ShutdownRequested() || fFailed)
+                        return;
+
+                    uint512 seedZerocoin = GetZerocoinSeed(vCounts[j]);
+                    CBigNum bnSerial;
+                    CBigNum bnRandomness;
+                    CKey key;
+                    SeedToZWSP(seedZerocoin, vValues[j], bnSerial, bnRandomness, key);
+                }
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(csError);
+                if (!fFailed)
+                    strError = e.what();
+                fFailed = true;
             }
-        }
+        });
+    }
+    threadGroup.join_all();
 
-        if(fFound)
-            continue;
+    if (fFailed)
+        return error("%s : failed to generate mints: %s", __func__, strError);
+    if (ShutdownRequested())
+        return false;
 
-        uint512 seedZerocoin = GetZerocoinSeed(i);
-        CBigNum bnValue;
-        CBigNum bnSerial;
-        CBigNum bnRandomness;
-        CKey key;
-        SeedToZWSP(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
+    CWalletDB walletdb(strWalletFile);
+    if (!walletdb.TxnBegin())
+        return error("%s : failed to begin database transaction", __func__);
+    for (unsigned int j = 0; j < vCounts.size(); j++) {
+        if (!walletdb.WriteMintPoolPair(hashSeed, GetPubCoinHash(vValues[j]), vCounts[j])) {
+            walletdb.TxnAbort();
+            return error("%s : failed to write mint count=%d", __func__, vCounts[j]);
+        }
+    }
+    if (!walletdb.TxnCommit())
+        return error("%s : failed to commit database transaction", __func__);
 
-        mintPool.Add(bnValue, i);
-        CWalletDB(strWalletFile).WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), i);
-        LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), i);
+    for (unsigned int j = 0; j < vCounts.size(); j++) {
+        mintPool.Add(vValues[j], vCounts[j]);
+        LogPrintf("%s : %s count=%d\n", __func__, vValues[j].GetHex().substr(0, 6), vCounts[j]);
     }
+    return true;
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without regenerating
@@ -188,8 +225,10 @@ void CzWSPWallet::SyncWithChain(bool fGenerateMintPool)
     std::set<uint256> setAddedTx;
     while (found) {
         found = false;
-        if (fGenerateMintPool)
-            GenerateMintPool();
+        if (fGenerateMintPool && !GenerateMintPool()) {
+            LogPrintf("%s: Failed to generate mint pool\n", __func__);
+            return;
+        }
         LogPrintf("%s: Mintpool size=%d\n", __func__, mintPool.size());
 
         std::set<uint256> setChecked;
@@ -372,8 +411,8 @@ void CzWSPWallet::SeedToZWSP(const uint512& seedZerocoin, CBigNum& bnValue, CBig
 
     //See if serial and randomness make a valid commitment
     // Generate a Pedersen commitment to the serial number
-    CBigNum commitmentValue = params->coinCommitmentGroup.g.pow_mod(bnSerial, params->coinCommitmentGroup.modulus).mul_mod(
-                        params->coinCommitmentGroup.h.pow_mod(bnRandomness, params->coinCommitmentGroup.modulus),
+    CBigNum commitmentValue = params->coinCommitmentGroup.powG(bnSerial).mul_mod(
+                        params->coinCommitmentGroup.powH(bnRandomness),
                         params->coinCommitmentGroup.modulus);
 
     CBigNum random;
@@ -395,7 +434,7 @@ void CzWSPWallet::SeedToZWSP(const uint512& seedZerocoin, CBigNum& bnValue, CBig
                               attempts256.begin(), attempts256.end());
         random.setuint256(hashRandomness);
         bnRandomness = (bnRandomness + random) % params->coinCommitmentGroup.groupOrder;
-        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.h.pow_mod(random, params->coinCommitmentGroup.modulus), params->coinCommitmentGroup.modulus);
+        commitmentValue = commitmentValue.mul_mod(params->coinCommitmentGroup.powH(random), params->coinCommitmentGroup.modulus);
     }
 }
 
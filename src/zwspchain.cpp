@@ -80,6 +80,32 @@ bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>&
     return true;
 }
 
+bool BlockIndexToPubcoinList(const CBlockIndex* pindex, std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    // Version 8 block index entries record the block's mints, and blocks without any have no pubcoin entry
+    if (pindex->nVersion > 7 && pindex->cold->vMintDenominationsInBlock.empty())
+        return true;
+
+    std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > vPubcoins;
+    if (zerocoinDB->ReadBlockPubcoins(pindex->GetBlockHash(), vPubcoins)) {
+        for (const auto& it : vPubcoins)
+            listPubcoins.emplace_back(Params().Zerocoin_Params(false), it.second, it.first);
+        return true;
+    }
+
+    // Blocks connected before the index existed are read from disk once and then indexed. Older
+    // blocks don't record whether they have mints, so they are indexed even when they have none.
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s: failed to read block %d from disk", __func__, pindex->nHeight);
+    if (!BlockToPubcoinList(block, listPubcoins, true))
+        return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+    if (!zerocoinDB->WriteBlockPubcoins(pindex->GetBlockHash(), listPubcoins))
+        LogPrintf("%s: failed to index pubcoins of block %d\n", __func__, pindex->nHeight);
+
+    return true;
+}
+
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid)
 {